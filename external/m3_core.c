@@ -48,6 +48,8 @@ uint64_t m3_GetTimestamp()
 
 #endif
 
+M3AllocationCallback m3_AllocationCallback = NULL;
+
 #if d_m3FixedHeap
 
 static u8 fixedHeap[d_m3FixedHeap];
@@ -126,6 +128,7 @@ void *  m3_Realloc_Impl  (void * i_ptr, size_t i_newSize, size_t i_oldSize)
 
 void *  m3_Malloc_Impl  (size_t i_size)
 {
+    if (m3_AllocationCallback) m3_AllocationCallback (i_size);
     return calloc (i_size, 1);
 }
 
@@ -137,6 +140,7 @@ void  m3_Free_Impl  (void * io_ptr)
 void *  m3_Realloc_Impl  (void * i_ptr, size_t i_newSize, size_t i_oldSize)
 {
     if (M3_UNLIKELY(i_newSize == i_oldSize)) return i_ptr;
+    if (m3_AllocationCallback) m3_AllocationCallback (i_newSize);
 
     void * newPtr = realloc (i_ptr, i_newSize);
 
@@ -482,7 +486,7 @@ M3Result  ReadLEB_i64  (i64 * o_value, bytes_t * io_bytes, cbytes_t i_end)
 }
 
 
-M3Result  Read_utf8  (cstr_t * o_utf8, bytes_t * io_bytes, cbytes_t i_end)
+M3Result  Read_utf8  (IM3Environment i_environment, cstr_t * o_utf8, bytes_t * io_bytes, cbytes_t i_end)
 {
     *o_utf8 = NULL;
 
@@ -498,14 +502,7 @@ M3Result  Read_utf8  (cstr_t * o_utf8, bytes_t * io_bytes, cbytes_t i_end)
 
             if (end <= i_end)
             {
-                char * utf8 = (char *)m3_Malloc ("UTF8", utf8Length + 1);
-
-                if (utf8)
-                {
-                    memcpy (utf8, ptr, utf8Length);
-                    utf8 [utf8Length] = 0;
-                    * o_utf8 = utf8;
-                }
+                result = Environment_InternName (i_environment, o_utf8, (const char *) ptr, utf8Length);
 
                 * io_bytes = end;
             }
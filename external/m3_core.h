@@ -217,6 +217,11 @@ uint64_t    m3_GetTimestamp         ();
 #endif
 
 void        m3_Abort                (const char* message);
+
+// called on each malloc and realloc, used by the host to detect allocations in places which should not allocate
+typedef void (* M3AllocationCallback) (size_t i_size);
+extern M3AllocationCallback m3_AllocationCallback;
+
 void *      m3_Malloc_Impl          (size_t i_size);
 void *      m3_Realloc_Impl         (void * i_ptr, size_t i_newSize, size_t i_oldSize);
 void        m3_Free_Impl            (void * i_ptr);
@@ -293,7 +298,8 @@ M3Result    ReadLEB_u7              (u8  * o_value, bytes_t * io_bytes, cbytes_t
 M3Result    ReadLEB_i7              (i8  * o_value, bytes_t * io_bytes, cbytes_t i_end);
 M3Result    ReadLEB_i32             (i32 * o_value, bytes_t * io_bytes, cbytes_t i_end);
 M3Result    ReadLEB_i64             (i64 * o_value, bytes_t * io_bytes, cbytes_t i_end);
-M3Result    Read_utf8               (cstr_t * o_utf8, bytes_t * io_bytes, cbytes_t i_end);
+// the returned name is interned in i_environment and lives until the environment is freed; don't free it
+M3Result    Read_utf8               (IM3Environment i_environment, cstr_t * o_utf8, bytes_t * io_bytes, cbytes_t i_end);
 
 cstr_t      SPrintValue             (void * i_value, u8 i_type);
 size_t      SPrintArg               (char * o_string, size_t i_stringBufferSize, voidptr_t i_sp, u8 i_type);
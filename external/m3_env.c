@@ -64,6 +64,100 @@ void  Environment_Release  (IM3Environment i_environment)
 
     m3log (runtime, "freeing %d pages from environment", CountCodePages (i_environment->pagesReleased));
     FreeCodePages (& i_environment->pagesReleased);
+
+    M3NameBlock * block = i_environment->names.blocks;
+
+    while (block)
+    {
+        M3NameBlock * next = block->next;
+        m3_Free (block);
+        block = next;
+    }
+
+    m3_Free (i_environment->names.slots);
+}
+
+
+static u32  HashName  (const char * i_name, u32 i_length)
+{
+    u32 hash = 2166136261u; // FNV-1a
+    for (u32 i = 0; i < i_length; ++i)
+    {
+        hash = (hash ^ (u8) i_name [i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+static cstr_t *  FindNameSlot  (cstr_t * i_slots, u32 i_numSlots, const char * i_name, u32 i_length)
+{
+    u32 mask = i_numSlots - 1;
+
+    for (u32 i = HashName (i_name, i_length) & mask; ; i = (i + 1) & mask)
+    {
+        cstr_t name = i_slots [i];
+
+        if (not name or (strncmp (name, i_name, i_length) == 0 and name [i_length] == 0))
+            return & i_slots [i];
+    }
+}
+
+
+M3Result  Environment_InternName  (IM3Environment i_environment, cstr_t * o_name, const char * i_name, u32 i_length)
+{
+    M3Result result = m3Err_none;
+    M3NameTable * table = & i_environment->names;
+
+    * o_name = NULL;
+
+    if ((table->numNames + 1) * 4 > table->numSlots * 3)
+    {
+        u32 numSlots = table->numSlots ? table->numSlots * 2 : 256;
+        cstr_t * slots = m3_AllocArray (cstr_t, numSlots);
+        _throwifnull (slots);
+
+        for (u32 i = 0; i < table->numSlots; ++i)
+        {
+            cstr_t name = table->slots [i];
+            if (name)
+                * FindNameSlot (slots, numSlots, name, (u32) strlen (name)) = name;
+        }
+
+        m3_Free (table->slots);
+        table->slots = slots;
+        table->numSlots = numSlots;
+    }
+
+    cstr_t * slot = FindNameSlot (table->slots, table->numSlots, i_name, i_length);
+
+    if (not * slot)
+    {
+        M3NameBlock * block = table->blocks;
+
+        if (not block or block->used + i_length + 1 > block->capacity)
+        {
+            u32 capacity = M3_MAX (i_length + 1, 4096);
+            block = (M3NameBlock *) m3_Malloc ("M3NameBlock", sizeof (M3NameBlock) + capacity);
+            _throwifnull (block);
+
+            block->next = table->blocks;
+            block->used = 0;
+            block->capacity = capacity;
+            table->blocks = block;
+        }
+
+        char * name = block->data + block->used;
+        memcpy (name, i_name, i_length);
+        name [i_length] = 0;
+        block->used += i_length + 1;
+
+        * slot = name;
+        ++table->numNames;
+    }
+
+    * o_name = * slot;
+
+    _catch: return result;
 }
 
 
@@ -369,10 +463,9 @@ M3Result  ResizeMemory  (IM3Runtime io_runtime, u32 i_numPages)
         _throwif("linear memory limitation exceeded", numPagesToAlloc > d_m3MaxLinearMemoryPages);
 #endif
 
-        // Limit the amount of memory that gets actually allocated
-        if (io_runtime->memoryLimit) {
-            numPageBytes = M3_MIN (numPageBytes, io_runtime->memoryLimit);
-        }
+        // memoryLimit is a hard cap, growing past it fails (memory.grow returns -1)
+        // instead of allocating less than the module asked for
+        _throwif(m3Err_wasmMemoryOverflow, io_runtime->memoryLimit && numPageBytes > io_runtime->memoryLimit);
 
         size_t numBytes = numPageBytes + sizeof (M3MemoryHeader);
 
@@ -116,6 +116,10 @@ typedef struct M3Module
 
     //bool                    hasWasmCodeCopy;
 
+    // state of m3_ParseModuleSection
+    bytes_t                 parsePos;
+    u8                      parseExpectedSection;
+
     struct M3Module *       next;
 }
 M3Module;
@@ -132,6 +136,29 @@ void                        FreeImportInfo              (M3ImportInfo * i_info);
 
 //---------------------------------------------------------------------------------------------------------------------------------
 
+// names read by the parser (imports, exports, name & custom sections) are interned here, so reparsing a module
+// does not allocate its names again and equal names share a pointer; not thread-safe, like the rest of the environment
+typedef struct M3NameBlock
+{
+    struct M3NameBlock *    next;
+    u32                     used;
+    u32                     capacity;
+    char                    data [];
+}
+M3NameBlock;
+
+typedef struct M3NameTable
+{
+    cstr_t *                slots;                              // open addressing, capacity is a power of two
+    u32                     numSlots;
+    u32                     numNames;
+
+    M3NameBlock *           blocks;                             // names are allocated from these, freed with the environment
+}
+M3NameTable;
+
+//---------------------------------------------------------------------------------------------------------------------------------
+
 typedef struct M3Environment
 {
 //    struct M3Runtime *      runtimes;
@@ -143,11 +170,16 @@ typedef struct M3Environment
     M3CodePage *            pagesReleased;
 
     M3SectionHandler        customSectionHandler;
+
+    M3NameTable             names;
 }
 M3Environment;
 
 void                        Environment_Release         (IM3Environment i_environment);
 
+// returns the persistent copy of i_name; it lives until the environment is freed
+M3Result                    Environment_InternName      (IM3Environment i_environment, cstr_t * o_name, const char * i_name, u32 i_length);
+
 // takes ownership of io_funcType and returns a pointer to the persistent version (could be same or different)
 void                        Environment_AddFuncType     (IM3Environment i_environment, IM3FuncType * io_funcType);
 
@@ -76,8 +76,9 @@ u8  GetFuncTypeResultType  (const IM3FuncType i_funcType, u16 i_index)
 
 void FreeImportInfo (M3ImportInfo * i_info)
 {
-    m3_Free (i_info->moduleUtf8);
-    m3_Free (i_info->fieldUtf8);
+    // names are interned in the environment
+    i_info->moduleUtf8 = NULL;
+    i_info->fieldUtf8 = NULL;
 }
 
 
@@ -85,15 +86,6 @@ void  Function_Release  (IM3Function i_function)
 {
     m3_Free (i_function->constants);
 
-    for (int i = 0; i < i_function->numNames; i++)
-    {
-        // name can be an alias of fieldUtf8
-        if (i_function->names[i] != i_function->import.fieldUtf8)
-        {
-            m3_Free (i_function->names[i]);
-        }
-    }
-
     FreeImportInfo (& i_function->import);
 
     if (i_function->ownsWasmCode)
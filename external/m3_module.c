@@ -36,7 +36,6 @@ void  m3_FreeModule  (IM3Module i_module)
 
         for (u32 i = 0; i < i_module->numGlobals; ++i)
         {
-            m3_Free (i_module->globals[i].name);
             FreeImportInfo(&(i_module->globals[i].import));
         }
         m3_Free (i_module->globals);
@@ -117,9 +116,9 @@ void  Module_GenerateNames  (IM3Module i_module)
 
         if (func->numNames == 0)
         {
-            char* buff = m3_AllocArray(char, 16);
-            snprintf(buff, 16, "$func%d", i);
-            func->names[0] = buff;
+            char buff [16];
+            int length = snprintf(buff, 16, "$func%d", i);
+            if (Environment_InternName (i_module->environment, & func->names[0], buff, (u32) length)) continue;
             func->numNames = 1;
         }
     }
@@ -129,9 +128,9 @@ void  Module_GenerateNames  (IM3Module i_module)
 
         if (global->name == NULL)
         {
-            char* buff = m3_AllocArray(char, 16);
-            snprintf(buff, 16, "$global%d", i);
-            global->name = buff;
+            char buff [16];
+            int length = snprintf(buff, 16, "$global%d", i);
+            Environment_InternName (i_module->environment, & global->name, buff, (u32) length);
         }
     }
 }
@@ -158,8 +158,8 @@ _   (Module_PreallocFunctions(io_module, numImports));
     {
         u8 importKind;
 
-_       (Read_utf8 (& import.moduleUtf8, & i_bytes, i_end));
-_       (Read_utf8 (& import.fieldUtf8, & i_bytes, i_end));
+_       (Read_utf8 (io_module->environment, & import.moduleUtf8, & i_bytes, i_end));
+_       (Read_utf8 (io_module->environment, & import.fieldUtf8, & i_bytes, i_end));
 _       (Read_u8 (& importKind, & i_bytes, i_end));                                 m3log (parse, "    kind: %d '%s.%s' ",
                                                                                                 (u32) importKind, import.moduleUtf8, import.fieldUtf8);
         switch (importKind)
@@ -233,7 +233,7 @@ _   (ReadLEB_u32 (& numExports, & i_bytes, i_end));
         u8 exportKind;
         u32 index;
 
-_       (Read_utf8 (& utf8, & i_bytes, i_end));
+_       (Read_utf8 (io_module->environment, & utf8, & i_bytes, i_end));
 _       (Read_u8 (& exportKind, & i_bytes, i_end));
 _       (ReadLEB_u32 (& index, & i_bytes, i_end));                                  m3log (parse, "    index: %3d; kind: %d; export: '%s'; ", index, (u32) exportKind, utf8);
 
@@ -245,24 +245,17 @@ _       (ReadLEB_u32 (& index, & i_bytes, i_end));
             {
                 func->names[func->numNames++] = utf8;
                 func->export_name = utf8;
-                utf8 = NULL; // ownership transferred to M3Function
             }
         }
         else if (exportKind == d_externalKind_global)
         {
             _throwif(m3Err_wasmMalformed, index >= io_module->numGlobals);
             IM3Global global = &(io_module->globals [index]);
-            m3_Free (global->name);
             global->name = utf8;
-            utf8 = NULL; // ownership transferred to M3Global
         }
-
-        m3_Free (utf8);
     }
 
-_catch:
-    m3_Free (utf8);
-    return result;
+    _catch: return result;
 }
 
 
@@ -502,7 +495,7 @@ _           (ReadLEB_u32 (& numNames, & i_bytes, i_end));
             {
                 u32 index;
 _               (ReadLEB_u32 (& index, & i_bytes, i_end));
-_               (Read_utf8 (& name, & i_bytes, i_end));
+_               (Read_utf8 (io_module->environment, & name, & i_bytes, i_end));
 
                 if (index < io_module->numFunctions)
                 {
@@ -511,12 +504,9 @@ _               (Read_utf8 (& name, & i_bytes, i_end));
                     {
                         func->names[0] = name;        m3log (parse, "    naming function%5d:  %s", index, name);
                         func->numNames = 1;
-                        name = NULL; // transfer ownership
                     }
 //                          else m3log (parse, "prenamed: %s", io_module->functions [index].name);
                 }
-
-                m3_Free (name);
             }
         }
 
@@ -532,7 +522,7 @@ M3Result  ParseSection_Custom  (M3Module * io_module, bytes_t i_bytes, cbytes_t
     M3Result result;
 
     cstr_t name;
-_   (Read_utf8 (& name, & i_bytes, i_end));
+_   (Read_utf8 (io_module->environment, & name, & i_bytes, i_end));
                                                                                     m3log (parse, "** Custom: '%s'", name);
     if (strcmp (name, "name") == 0) {
 _       (ParseSection_Name(io_module, i_bytes, i_end));
@@ -540,8 +530,6 @@ _       (ParseSection_Name(io_module, i_bytes, i_end));
 _       (io_module->environment->customSectionHandler(io_module, name, i_bytes, i_end));
     }
 
-    m3_Free (name);
-
     _catch: return result;
 }
 
@@ -588,13 +576,13 @@ M3Result  ParseModuleSection  (M3Module * o_module, u8 i_sectionType, bytes_t i_
 }
 
 
-M3Result  m3_ParseModule  (IM3Environment i_environment, IM3Module * o_module, cbytes_t i_bytes, u32 i_numBytes)
+M3Result  m3_ParseModuleBegin  (IM3Environment i_environment, IM3Module * o_module, cbytes_t i_bytes, u32 i_numBytes)
 {
     IM3Module module;                                                               m3log (parse, "load module: %d bytes", i_numBytes);
 _try {
     module = m3_AllocStruct (M3Module);
     _throwifnull (module);
-    module->name = ".unnamed";                                                      m3log (parse, "load module: %d bytes", i_numBytes);
+    module->name = ".unnamed";
     module->startFunction = -1;
     //module->hasWasmCodeCopy = false;
     module->environment = i_environment;
@@ -612,18 +600,42 @@ _   (Read_u32 (& version, & pos, end));
     _throwif (m3Err_wasmMalformed, magic != 0x6d736100);
     _throwif (m3Err_incompatibleWasmVersion, version != 1);
 
+    module->parsePos = pos;
+    module->parseExpectedSection = 0;
+
+} _catch:
+
+    if (result)
+    {
+        m3_FreeModule (module);
+        module = NULL;
+    }
+
+    * o_module = module;
+
+    return result;
+}
+
+
+M3Result  m3_ParseModuleSection  (IM3Module * io_module, int * o_done)
+{
+    IM3Module module = * io_module;
+    * o_done = 0;
+_try {
     static const u8 sectionsOrder[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 12, 10, 11, 0 }; // 0 is a placeholder
-    u8 expectedSection = 0;
 
-    while (pos < end)
+    const u8 * pos = module->parsePos;
+    const u8 * end = module->wasmEnd;
+
+    if (pos < end)
     {
         u8 section;
 _       (ReadLEB_u7 (& section, & pos, end));
 
         if (section != 0) {
             // Ensure sections appear only once and in order
-            while (sectionsOrder[expectedSection++] != section) {
-                _throwif(m3Err_misorderedWasmSection, expectedSection >= 12);
+            while (sectionsOrder[module->parseExpectedSection++] != section) {
+                _throwif(m3Err_misorderedWasmSection, module->parseExpectedSection >= 12);
             }
         }
 
@@ -634,17 +646,32 @@ _       (ReadLEB_u32 (& sectionLength, & pos, end));
 _       (ParseModuleSection (module, section, pos, sectionLength));
 
         pos += sectionLength;
+        module->parsePos = pos;
     }
 
+    * o_done = (pos >= end);
+
 } _catch:
 
     if (result)
     {
         m3_FreeModule (module);
-        module = NULL;
+        * io_module = NULL;
     }
 
-    * o_module = module;
+    return result;
+}
+
+
+M3Result  m3_ParseModule  (IM3Environment i_environment, IM3Module * o_module, cbytes_t i_bytes, u32 i_numBytes)
+{
+    M3Result result = m3_ParseModuleBegin (i_environment, o_module, i_bytes, i_numBytes);
+
+    int done = 0;
+    while (not result and not done)
+    {
+        result = m3_ParseModuleSection (o_module, & done);
+    }
 
     return result;
 }
@@ -232,6 +232,16 @@ d_m3ErrorConst  (trapStackOverflow,             "[trap] stack overflow")
                                                      const uint8_t * const  i_wasmBytes,
                                                      uint32_t               i_numWasmBytes);
 
+    // incremental variant of m3_ParseModule, parses the module one section per
+    // m3_ParseModuleSection call, until o_done is set; on error the module is freed and *io_module set to null
+    M3Result            m3_ParseModuleBegin         (IM3Environment         i_environment,
+                                                     IM3Module *            o_module,
+                                                     const uint8_t * const  i_wasmBytes,
+                                                     uint32_t               i_numWasmBytes);
+
+    M3Result            m3_ParseModuleSection       (IM3Module *            io_module,
+                                                     int *                  o_done);
+
     // Only modules not loaded into a M3Runtime need to be freed. A module is considered unloaded if
     // a. m3_LoadModule has not yet been called on that module. Or,
     // b. m3_LoadModule returned a result.
@@ -1,3 +1,8 @@
+newoption {
+	trigger = "visualscript-profiler",
+	description = "Record wasm3 backtraces so the sampling profiler can map samples to nodes"
+}
+
 project "visualscript"
 	libType()
 	files { 
@@ -9,6 +14,7 @@ project "visualscript"
 		"genie.lua"
 	}
 	defines { "BUILDING_VISUALSCRIPT" }
+	if _OPTIONS["visualscript-profiler"] then defines { "d_m3RecordBacktraces=1" } end
 	links { "engine", "core" }
 	if build_studio then
 		links { "editor" }
@@ -1,4 +1,5 @@
 #include "core/allocator.h"
+#include "core/command_line_parser.h"
 #include "core/crt.h"
 #include "core/log.h"
 #include "core/math.h"
@@ -54,6 +55,7 @@ enum class WASMGlobals : u32 {
 };
 
 enum class WASMSection : u8 {
+	CUSTOM = 0,
 	TYPE = 1,
 	IMPORT = 2,
 	FUNCTION = 3,
@@ -173,9 +175,12 @@ struct Node : NodeEditorNode {
 	void generateNext(OutputMemoryStream& blob, const Graph& graph) {
 		NodeInput n = getOutputNode(0, graph);
 		if (!n.node) return;
-		n.node->generate(blob, graph, n.input_idx);
+		n.node->emit(blob, graph, n.input_idx);
 	}
 
+	// generate, recording where the node's code starts and ends, see Graph::m_code_map
+	void emit(OutputMemoryStream& blob, const Graph& graph, u32 idx);
+
 	void clearError() { m_error = ""; }
 
 	virtual Type getType() const = 0;
@@ -184,13 +189,14 @@ struct Node : NodeEditorNode {
 	virtual void serialize(OutputMemoryStream& blob) const {}
 	virtual void deserialize(InputMemoryStream& blob) {}
 	virtual ScriptValueType getOutputType(u32 idx, const Graph& graph) { return ScriptValueType::I32; }
+	virtual void collectAccess(ScriptResource::AccessSet& access) const {}
 
 	bool m_selected = false;
 protected:
 	struct NodeInput {
 		Node* node;
 		u32 input_idx;
-		void generate(OutputMemoryStream& blob, const Graph& graph) { node->generate(blob, graph, input_idx); }
+		void generate(OutputMemoryStream& blob, const Graph& graph) { node->emit(blob, graph, input_idx); }
 	};
 
 	NodeInput getOutputNode(u32 idx, const Graph& graph);
@@ -201,7 +207,7 @@ protected:
 		u32 output_idx;
 		operator bool() const { return node; }
 		void generate(OutputMemoryStream& blob, const Graph& graph) {
-			node->generate(blob, graph, output_idx);
+			node->emit(blob, graph, output_idx);
 		}
 	};
 
@@ -246,6 +252,20 @@ static void writeLEB128(OutputMemoryStream& blob, u64 val) {
   } while (!end);
 }
 
+// Graph is not complete yet
+static void setCodeMap(Graph& graph, Array<ScriptResource::NodeCodeRange>* map);
+
+// writes ScriptResource::Validation of `wasm`, `res` is the result of ScriptResource::validate;
+// the runtime trusts only validated scripts
+static void writeValidation(OutputMemoryStream& blob, Span<const u8> wasm, M3Result res) {
+	ScriptResource::Validation validation;
+	if (res == m3Err_none) {
+		validation.validated = true;
+		validation.hash = StableHash(wasm.begin(), wasm.length());
+	}
+	blob.write(validation);
+}
+
 struct WASMWriter {
 	using TypeHandle = u32;
 	using FunctionHandle = u32;
@@ -267,22 +287,62 @@ struct WASMWriter {
 		import.ret_type = ret_type;
 	}
 
-	void addFunctionExport(const char* name, Node* node, Span<const WASMType> args) {
+	void addFunctionExport(ScriptResource::Metadata::EntryPoint entry_point, Node* node, Span<const WASMType> args) {
 		Export& e = m_exports.emplace(m_allocator);
 		e.node = node;
-		e.name = name;
+		e.entry_point = entry_point;
+		e.name = ScriptResource::Metadata::ENTRY_POINT_NAMES[(u32)entry_point];
 		ASSERT(args.length() <= lengthOf(e.args));
 		if (args.length() > 0) memcpy(e.args, args.begin(), args.length() * sizeof(args[0]));
 		e.num_args = args.length();
 	}
 	
-	void addGlobal(WASMType type, const char* export_name) {
+	void addGlobal(ScriptValueType type, const char* export_name) {
 		Global& global = m_globals.emplace(m_allocator);
-		global.type = type;
+		global.value_type = type;
+		switch (type) {
+			case ScriptValueType::I32:
+			case ScriptValueType::ENTITY:
+				global.type = WASMType::I32;
+				break;
+			case ScriptValueType::FLOAT:
+				global.type = WASMType::F32;
+				break;
+			default: ASSERT(false); break;
+		}
 		if (export_name) global.export_name = export_name;
 	}
 
+	// call after write
+	void fillMetadata(ScriptResource::Metadata& metadata) const {
+		metadata.clear();
+		metadata.valid = true;
+		for (const Export& e : m_exports) {
+			metadata.entry_points[(u32)e.entry_point] = m_imports.size() + u32(&e - m_exports.begin());
+		}
+		for (const Global& g : m_globals) {
+			if (g.export_name.length() == 0) continue;
+			const u32 idx = u32(&g - m_globals.begin());
+			if (g.value_type == ScriptValueType::ENTITY && equalStrings(g.export_name.c_str(), "self")) metadata.self_global = idx;
+			ScriptResource::Metadata::Global& global = metadata.globals.emplace(m_allocator);
+			global.name = g.export_name;
+			global.type = g.value_type;
+			global.index = idx;
+		}
+		for (const Import& i : m_imports) {
+			ScriptResource::Metadata::Import& import = metadata.imports.emplace(m_allocator);
+			import.module = i.module_name;
+			import.field = i.field_name;
+			import.function = u32(&i - m_imports.begin());
+		}
+		// entry points call only imports, so the deepest frame is one function's; wasm3 needs at most two slots
+		// per argument and four per byte of code (a constant slot and an operand, i64 and f64 taking two each)
+		static constexpr u32 RESERVED_SLOTS = 16;
+		metadata.stack_size = (m_max_frame_slots * 4 + RESERVED_SLOTS) * sizeof(u32);
+	}
+
 	void write(OutputMemoryStream& blob, Graph& graph) {
+		const u64 wasm_start = blob.size();
 		blob.write(u32(0x6d736100));
 		blob.write(u32(1));
 	
@@ -379,17 +439,39 @@ struct WASMWriter {
 			}
 		});
 
-		writeSection(blob, WASMSection::CODE, [this, &graph](OutputMemoryStream& blob){
+		Array<ScriptResource::NodeCodeRange> func_map(m_allocator);
+		Array<ScriptResource::NodeCodeRange> code_map(m_allocator);
+		setCodeMap(graph, &func_map);
+		const u64 code_start = writeSection(blob, WASMSection::CODE, [&](OutputMemoryStream& blob){
 			writeLEB128(blob, m_exports.size());
 			OutputMemoryStream func_blob(m_allocator);
 			
+			m_max_frame_slots = 0;
 			for (const Export& code : m_exports) {
 				func_blob.clear();
-				code.node->generate(func_blob, graph, 0);
+				func_map.clear();
+				code.node->emit(func_blob, graph, 0);
+				m_max_frame_slots = maximum(m_max_frame_slots, code.num_args + (u32)func_blob.size());
 				writeLEB128(blob, (u32)func_blob.size());
+				for (ScriptResource::NodeCodeRange range : func_map) {
+					range.offset += (u32)blob.size();
+					code_map.push(range);
+				}
 				blob.write(func_blob.data(), func_blob.size());
 			}
 		});
+		setCodeMap(graph, nullptr);
+
+		// offsets are relative to the start of the wasm module, the same as in wasm3's code page mapping
+		const u32 code_offset = u32(code_start - wasm_start);
+		writeSection(blob, WASMSection::CUSTOM, [&](OutputMemoryStream& blob){
+			writeString(blob, ScriptResource::NODE_MAP_SECTION);
+			writeLEB128(blob, code_map.size());
+			for (const ScriptResource::NodeCodeRange& range : code_map) {
+				writeLEB128(blob, range.offset + code_offset);
+				writeLEB128(blob, range.node);
+			}
+		});
 	}
 	
 	static void writeString(OutputMemoryStream& blob, const char* value) {
@@ -398,18 +480,22 @@ struct WASMWriter {
 		blob.write(value, len);
 	}
 
+	// returns offset of the section's content in `blob`
 	template <typename F>
-	void writeSection(OutputMemoryStream& blob, WASMSection section, F f) const {
+	u64 writeSection(OutputMemoryStream& blob, WASMSection section, F f) const {
 		OutputMemoryStream tmp(m_allocator);
 		f(tmp);
 		blob.write(section);
 		writeLEB128(blob, (u32)tmp.size());
+		const u64 offset = blob.size();
 		blob.write(tmp.data(), tmp.size());
+		return offset;
 	}
 
 	struct Export {
 		Export(IAllocator& allocator) : name(allocator) {}
 		Node* node = nullptr;
+		ScriptResource::Metadata::EntryPoint entry_point;
 		String name;
 		u32 num_args = 0;
 		WASMType args[8];
@@ -419,6 +505,7 @@ struct WASMWriter {
 		Global(IAllocator& allocator) : export_name(allocator) {}
 		String export_name;
 		WASMType type;
+		ScriptValueType value_type;
 	};
 
 	struct Import {
@@ -434,9 +521,14 @@ struct WASMWriter {
 	Array<Import> m_imports;
 	Array<Global> m_globals;
 	Array<Export> m_exports;
+	// upper bound of wasm3 stack slots used by a single function, see fillMetadata
+	u32 m_max_frame_slots = 0;
 };
 
 struct Graph {
+	// bytes added to the deepest frame when the slot estimate is too low
+	static constexpr u32 STACK_MARGIN = 16 * sizeof(u64);
+
 	Graph(const Path& path, IAllocator& allocator)
 		: m_allocator(allocator)
 		, m_nodes(allocator)
@@ -469,11 +561,11 @@ struct Graph {
 	static constexpr u32 MAGIC = '_LVS';
 	
 	template <typename... Args>
-	void addExport(WASMWriter& writer, Node::Type node_type, const char* name, Args... args) {
+	void addExport(WASMWriter& writer, Node::Type node_type, ScriptResource::Metadata::EntryPoint entry_point, Args... args) {
 		for (Node* n : m_nodes) {
 			if (n->getType() == node_type) {
 				WASMType a[] = { args..., WASMType::VOID };
-				writer.addFunctionExport(name, n, Span(a, lengthOf(a) - 1));
+				writer.addFunctionExport(entry_point, n, Span(a, lengthOf(a) - 1));
 				break;
 			}
 		}
@@ -485,37 +577,59 @@ struct Graph {
 		writer.addFunctionImport(module_name, field_name, ret_type, Span(a, lengthOf(a)));
 	}
 
+	// separate from generate, so the compiler benchmark can time WASMWriter::write on its own
+	void initWriter(WASMWriter& writer) {
+		using EntryPoint = ScriptResource::Metadata::EntryPoint;
+		addExport(writer, Node::Type::UPDATE, EntryPoint::UPDATE, WASMType::F32);
+		addExport(writer, Node::Type::MOUSE_MOVE, EntryPoint::MOUSE_MOVE, WASMType::F32, WASMType::F32);
+		addExport(writer, Node::Type::KEY_INPUT, EntryPoint::KEY_EVENT, WASMType::I32);
+		addExport(writer, Node::Type::START, EntryPoint::START);
+		
+		addImport(writer, "LumixAPI", "setYaw", WASMType::VOID, WASMType::I32, WASMType::F32);
+		addImport(writer, "LumixAPI", "setPropertyFloat", WASMType::VOID, WASMType::I32, WASMType::I64, WASMType::F32);
+		addImport(writer, "LumixAPI", "getPropertyFloat", WASMType::F32,  WASMType::I32, WASMType::I64);
+
+		writer.addGlobal(ScriptValueType::ENTITY, "self");
+		for (const Variable& var : m_variables) {
+			writer.addGlobal(var.type, var.name.c_str());
+		}
+	}
+
 	void generate(OutputMemoryStream& blob) {
 		for (Node* node : m_nodes) {
 			node->clearError();
 		}
 
 		WASMWriter writer(m_allocator);
-		addExport(writer, Node::Type::UPDATE, "update", WASMType::F32);
-		addExport(writer, Node::Type::MOUSE_MOVE, "onMouseMove", WASMType::F32, WASMType::F32);
-		addExport(writer, Node::Type::KEY_INPUT, "onKeyEvent", WASMType::I32);
-		addExport(writer, Node::Type::START, "start");
-		
-		addImport(writer, "LumixAPI", "setYaw", WASMType::VOID, WASMType::I32, WASMType::F32);
-		addImport(writer, "LumixAPI", "setPropertyFloat", WASMType::VOID, WASMType::I32, WASMType::I64, WASMType::F32);
-		addImport(writer, "LumixAPI", "getPropertyFloat", WASMType::F32,  WASMType::I32, WASMType::I64);
+		initWriter(writer);
 
-		writer.addGlobal(WASMType::I32, "self");
-		for (const Variable& var : m_variables) {
-			switch (var.type) {
-				case ScriptValueType::I32:
-					writer.addGlobal(WASMType::I32, var.name.c_str());
-					break;
-				case ScriptValueType::FLOAT:
-					writer.addGlobal(WASMType::F32, var.name.c_str());
-					break;
-				default: ASSERT(false); break;
-			}
+		ScriptResource::AccessSet access(m_allocator);
+		access.flags = ScriptResource::AccessSet::NONE;
+		for (const Node* node : m_nodes) {
+			node->collectAccess(access);
+		}
+
+		// metadata precedes the wasm, but depends on what's written
+		OutputMemoryStream wasm(m_allocator);
+		writer.write(wasm, *this);
+		ScriptResource::Metadata metadata(m_allocator);
+		writer.fillMetadata(metadata);
+
+		// the slot estimate can be lower than what wasm3 compiles to, the runtime would then overflow on the first call
+		const Span<const u8> wasm_span(wasm.data(), (u32)wasm.size());
+		u32 max_frame_size = 0;
+		m_validation_error = ScriptResource::validate(wasm_span, metadata.stack_size, &max_frame_size);
+		if (m_validation_error == m3Err_trapStackOverflow) {
+			metadata.stack_size = max_frame_size + STACK_MARGIN;
+			m_validation_error = ScriptResource::validate(wasm_span, metadata.stack_size);
 		}
 
 		ScriptResource::Header header;
 		blob.write(header);
-		writer.write(blob, *this);
+		access.serialize(blob);
+		metadata.serialize(blob);
+		writeValidation(blob, wasm_span, m_validation_error);
+		blob.write(wasm.data(), wasm.size());
 	}
 
 	void clear() {
@@ -621,10 +735,32 @@ struct Graph {
 	Array<NodeEditorLink> m_links;
 	Array<Variable> m_variables;
 	Path m_path;
+	// why the last generated script was not validated, null if it was
+	M3Result m_validation_error = m3Err_none;
+	// where generated code of nodes starts, relative to the function being generated; only set by WASMWriter::write
+	Array<ScriptResource::NodeCodeRange>* m_code_map = nullptr;
 
 	u32 m_node_counter = 0;
 };
 
+static void setCodeMap(Graph& graph, Array<ScriptResource::NodeCodeRange>* map) {
+	graph.m_code_map = map;
+}
+
+void Node::emit(OutputMemoryStream& blob, const Graph& graph, u32 idx) {
+	Array<ScriptResource::NodeCodeRange>* map = graph.m_code_map;
+	if (!map) {
+		generate(blob, graph, idx);
+		return;
+	}
+
+	// nodes are generated recursively, after a node is done the code belongs to its parent again
+	const u32 parent = map->empty() ? ScriptResource::NodeCodeRange::NO_NODE : map->back().node;
+	map->push({(u32)blob.size(), m_id});
+	generate(blob, graph, idx);
+	map->push({(u32)blob.size(), parent});
+}
+
 Node::NodeInput Node::getOutputNode(u32 idx, const Graph& graph) {
 	const i32 i = graph.m_links.find([&](NodeEditorLink& l){
 		return l.getFromNode() == m_id && l.getFromPin() == idx;
@@ -793,7 +929,7 @@ struct SequenceNode : Node {
 		for (u32 i = 0; ; ++i) {
 			NodeInput n = getOutputNode(i, graph);
 			if (!n.node) return;
-			n.node->generate(blob, graph, 0);
+			n.node->emit(blob, graph, 0);
 		}
 	}
 	Graph& m_graph;
@@ -893,6 +1029,10 @@ struct SetYawNode : Node {
 	bool hasInputPins() const override { return true; }
 	bool hasOutputPins() const override { return true; }
 
+	void collectAccess(ScriptResource::AccessSet& access) const override {
+		access.flags |= ScriptResource::AccessSet::WRITE_TRANSFORM;
+	}
+
 	bool onGUI() override {
 		nodeTitle("Set entity yaw", true, true);
 		inputPin(); ImGui::TextUnformatted("Entity");
@@ -963,12 +1103,12 @@ struct SwitchNode : Node {
 		if (m_is_on) {
 			NodeInput n = getOutputNode(0, graph);
 			if (!n.node) return;
-			n.node->generate(blob, graph, n.input_idx);
+			n.node->emit(blob, graph, n.input_idx);
 		}
 		else {
 			NodeInput n = getOutputNode(1, graph);
 			if (!n.node) return;
-			n.node->generate(blob, graph, n.input_idx);
+			n.node->emit(blob, graph, n.input_idx);
 		}
 	}
 
@@ -996,7 +1136,7 @@ struct KeyInputNode : Node {
 			case 0: {
 				blob.write(u8(0)); // num locals
 				NodeInput o = getOutputNode(0, graph);
-				if(o.node) o.node->generate(blob, graph, o.input_idx);
+				if(o.node) o.node->emit(blob, graph, o.input_idx);
 				blob.write(WasmOp::END);
 			}
 			case 1:
@@ -1034,7 +1174,7 @@ struct MouseMoveNode : Node {
 			case 0: {
 				blob.write(u8(0)); // num locals
 				NodeInput o = getOutputNode(0, graph);
-				if(o.node) o.node->generate(blob, graph, o.input_idx);
+				if(o.node) o.node->emit(blob, graph, o.input_idx);
 				blob.write(WasmOp::END);
 			}
 			case 1:
@@ -1108,7 +1248,7 @@ struct StartNode : Node {
 	void generate(OutputMemoryStream& blob, const Graph& graph, u32 pin_idx) override {
 		blob.write(u8(0)); // num locals
 		NodeInput o = getOutputNode(0, graph);
-		if(o.node) o.node->generate(blob, graph, o.input_idx);
+		if(o.node) o.node->emit(blob, graph, o.input_idx);
 		blob.write(WasmOp::END);
 	}
 };
@@ -1134,7 +1274,7 @@ struct UpdateNode : Node {
 		if (pin_idx == 0) {
 			blob.write(u8(0)); // num locals
 			NodeInput o = getOutputNode(0, graph);
-			if(o.node) o.node->generate(blob, graph, o.input_idx);
+			if(o.node) o.node->emit(blob, graph, o.input_idx);
 			blob.write(WasmOp::END);
 		}
 		else {
@@ -1357,6 +1497,10 @@ struct GetPropertyNode : Node {
 		cmp_type = reflection::getComponentType(blob.readString());
 	}
 
+	void collectAccess(ScriptResource::AccessSet& access) const override {
+		access.addRead(reflection::getPropertyHash(cmp_type, prop));
+	}
+
 	bool onGUI() override {
 		nodeTitle("Get property", false, false);
 		
@@ -1420,6 +1564,10 @@ struct SetPropertyNode : Node {
 		cmp_type = reflection::getComponentType(blob.readString());
 	}
 
+	void collectAccess(ScriptResource::AccessSet& access) const override {
+		access.addWrite(reflection::getPropertyHash(cmp_type, prop));
+	}
+
 	void generate(OutputMemoryStream& blob, const Graph& graph, u32) override {
 		// TODO handle other types than float
 		NodeOutput o1 = getInputNode(1, graph);
@@ -1904,6 +2052,155 @@ Node* Graph::createNode(Node::Type type) {
 	return nullptr;
 }
 
+// synthetic graphs of configurable size and shape, used to benchmark the graph compiler
+struct GraphGenerator {
+	enum class Shape : u32 {
+		CHAIN,		// set yaw(self, ((time_delta + 1) + 1) + ...)
+		WIDE,		// sequence of set yaw nodes
+		NESTED_IFS,	// ifs nested in true branches
+		SHARED		// one subexpression used by many set yaw nodes
+	};
+
+	GraphGenerator(Graph& graph) : m_graph(graph) {}
+
+	void link(Node* from, u32 from_pin, Node* to, u32 to_pin) {
+		NodeEditorLink& link = m_graph.m_links.emplace();
+		link.from = from->m_id | (from_pin << 16) | OUTPUT_FLAG;
+		link.to = to->m_id | (to_pin << 16);
+	}
+
+	Node* constant(float value) {
+		ConstNode* node = (ConstNode*)m_graph.addNode<ConstNode>(m_graph.m_allocator);
+		node->m_value = value;
+		return node;
+	}
+
+	// sets yaw of self to `value`
+	Node* setYaw(Node* value, u32 value_pin) {
+		Node* node = m_graph.addNode<SetYawNode>(m_graph.m_allocator);
+		link(m_graph.addNode<SelfNode>(m_graph.m_allocator), 0, node, 1);
+		link(value, value_pin, node, 2);
+		return node;
+	}
+
+	// node ids are 15 bits in links, so keep `size` in thousands
+	void generate(Shape shape, u32 size) {
+		m_graph.clear();
+		Node* update = m_graph.addNode<UpdateNode>(m_graph.m_allocator);
+		switch (shape) {
+			case Shape::CHAIN: {
+				Node* value = update;
+				u32 value_pin = 1;
+				for (u32 i = 0; i < size; ++i) {
+					Node* add = m_graph.addNode<AddNode>(m_graph.m_allocator);
+					link(value, value_pin, add, 0);
+					link(constant(1), 0, add, 1);
+					value = add;
+					value_pin = 0;
+				}
+				link(update, 0, setYaw(value, value_pin), 0);
+				break;
+			}
+			case Shape::WIDE: {
+				Node* sequence = m_graph.addNode<SequenceNode>(m_graph);
+				link(update, 0, sequence, 0);
+				for (u32 i = 0; i < size; ++i) link(sequence, i, setYaw(constant((float)i), 0), 0);
+				break;
+			}
+			case Shape::NESTED_IFS: {
+				Node* prev = update;
+				for (u32 i = 0; i < size; ++i) {
+					Node* if_node = m_graph.addNode<IfNode>(m_graph.m_allocator);
+					Node* cmp = m_graph.addNode<CompareNode<Node::Type::GT>>(m_graph.m_allocator);
+					link(update, 1, cmp, 0);
+					link(constant((float)i), 0, cmp, 1);
+					link(prev, 0, if_node, 0);
+					link(cmp, 0, if_node, 1);
+					link(if_node, 1, setYaw(constant((float)i), 0), 0);
+					prev = if_node;
+				}
+				link(prev, 0, setYaw(constant(0), 0), 0);
+				break;
+			}
+			case Shape::SHARED: {
+				Node* shared = m_graph.addNode<MulNode>(m_graph.m_allocator);
+				link(update, 1, shared, 0);
+				link(constant(2), 0, shared, 1);
+				Node* sequence = m_graph.addNode<SequenceNode>(m_graph);
+				link(update, 0, sequence, 0);
+				for (u32 i = 0; i < size; ++i) link(sequence, i, setYaw(shared, 0), 0);
+				break;
+			}
+		}
+	}
+
+	Graph& m_graph;
+};
+
+// times Graph::deserialize, Graph::generate and WASMWriter::write on generated graphs, results are written as JSON lines
+static void runCompilerBenchmark(const char* output_path, IAllocator& allocator) {
+	PROFILE_FUNCTION();
+	static const struct {
+		GraphGenerator::Shape shape;
+		const char* name;
+	} SHAPES[] = {
+		{ GraphGenerator::Shape::CHAIN, "chain" },
+		{ GraphGenerator::Shape::WIDE, "wide" },
+		{ GraphGenerator::Shape::NESTED_IFS, "nested_ifs" },
+		{ GraphGenerator::Shape::SHARED, "shared" },
+	};
+	static const u32 SIZES[] = { 10, 100, 1000 };
+
+	OutputMemoryStream out(allocator);
+	for (const auto& shape : SHAPES) {
+		for (u32 size : SIZES) {
+			Graph graph(Path(), allocator);
+			GraphGenerator(graph).generate(shape.shape, size);
+			OutputMemoryStream serialized(allocator);
+			graph.serialize(serialized);
+
+			os::Timer timer;
+			Graph loaded(Path(), allocator);
+			InputMemoryStream serialized_blob(serialized);
+			if (!loaded.deserialize(serialized_blob)) {
+				logError("Compiler benchmark ", shape.name, " failed to deserialize");
+				continue;
+			}
+			const double deserialize_time = timer.tick();
+
+			OutputMemoryStream compiled(allocator);
+			loaded.generate(compiled);
+			const double generate_time = timer.tick();
+
+			WASMWriter writer(allocator);
+			loaded.initWriter(writer);
+			OutputMemoryStream wasm(allocator);
+			timer.tick();
+			writer.write(wasm, loaded);
+			const double write_time = timer.tick();
+
+			out << "{\"name\": \"compiler/" << shape.name << "\""
+				<< ", \"size\": " << size
+				<< ", \"nodes\": " << loaded.m_nodes.size()
+				<< ", \"links\": " << loaded.m_links.size()
+				<< ", \"deserialize_ms\": " << deserialize_time * 1000
+				<< ", \"generate_ms\": " << generate_time * 1000
+				<< ", \"write_ms\": " << write_time * 1000
+				<< ", \"output_bytes\": " << (u64)compiled.size()
+				<< "}\n";
+		}
+	}
+
+	os::OutputFile file;
+	if (!file.open(output_path)) {
+		logError("Failed to create ", output_path);
+		return;
+	}
+	if (!file.write(out.data(), out.size())) logError("Failed to write ", output_path);
+	file.close();
+	logInfo("Compiler benchmark results written to ", output_path);
+}
+
 struct VisualScriptEditor : StudioApp::IPlugin, PropertyGrid::IPlugin {
 	VisualScriptEditor(StudioApp& app)
 		: m_allocator(app.getAllocator(), "visual script editor")
@@ -1935,6 +2232,25 @@ struct VisualScriptEditor : StudioApp::IPlugin, PropertyGrid::IPlugin {
 		if (!script.m_resource->isReady()) return;
 		if (!script.m_module) return;
 
+		const ScriptResource::Metadata& metadata = script.m_resource->m_metadata;
+		if (metadata.valid) {
+			for (const ScriptResource::Metadata::Global& global : metadata.globals) {
+				M3TaggedValue val;
+				m3_GetGlobal(m3l_getGlobal(script.m_module, global.index), &val);
+				switch (global.type) {
+					case ScriptValueType::I32:
+					case ScriptValueType::ENTITY:
+						ImGui::LabelText(global.name.c_str(), "%d", val.value.i32);
+						break;
+					case ScriptValueType::FLOAT:
+						ImGui::LabelText(global.name.c_str(), "%f", val.value.f32);
+						break;
+					default: ASSERT(false); break;
+				}
+			}
+			return;
+		}
+
 		for (i32 i = 0; i < m3l_getGlobalCount(script.m_module); ++i) {
 			const char* name = m3l_getGlobalName(script.m_module, i);
 			if (!name) continue;
@@ -1963,7 +2279,22 @@ struct VisualScriptEditor : StudioApp::IPlugin, PropertyGrid::IPlugin {
 		m_app.getAssetBrowser().addWindow(new_win.move());
 	}
 
-	void init() override {}
+	void init() override {
+		char cmd_line[2048];
+		if (!os::getCommandLine(Span(cmd_line))) return;
+
+		CommandLineParser parser(cmd_line);
+		while (parser.next()) {
+			if (!parser.currentEquals("-visualscript_compiler_benchmark")) continue;
+			if (!parser.next()) break;
+
+			char output_path[MAX_PATH];
+			parser.getCurrent(output_path, lengthOf(output_path));
+			runCompilerBenchmark(output_path, m_allocator);
+			break;
+		}
+	}
+
 	const char* getName() const override { return "visual_script_editor"; }
 	bool showGizmo(struct WorldView& view, struct ComponentUID cmp) override { return false; }
 
@@ -1981,11 +2312,21 @@ struct VisualScriptEditor : StudioApp::IPlugin, PropertyGrid::IPlugin {
 				ScriptResource::Header header;
 				OutputMemoryStream compiled(m_editor.m_allocator);
 				compiled.write(header);
+				// we do not know what hand-written wasm accesses
+				ScriptResource::AccessSet access(m_editor.m_allocator);
+				access.serialize(compiled);
+				// nor anything else, so it's looked up by name at runtime
+				ScriptResource::Metadata metadata(m_editor.m_allocator);
+				metadata.serialize(compiled);
 				OutputMemoryStream wasm(m_editor.m_allocator);
 				if (!fs.getContentSync(src, wasm)) {
 					logError("Failed to read ", src);
 					return false;
 				}
+				const Span<const u8> wasm_span(wasm.data(), (u32)wasm.size());
+				const M3Result validation_res = ScriptResource::validate(wasm_span, ScriptResource::Metadata::DEFAULT_STACK_SIZE);
+				writeValidation(compiled, wasm_span, validation_res);
+				if (validation_res != m3Err_none) logWarning(src, ": not validated, ", validation_res);
 				compiled.write(wasm.data(), wasm.size());
 				return m_editor.m_app.getAssetCompiler().writeCompiledResource(src, Span(compiled.data(), (u32)compiled.size()));
 			}
@@ -2005,6 +2346,7 @@ struct VisualScriptEditor : StudioApp::IPlugin, PropertyGrid::IPlugin {
 
 				OutputMemoryStream compiled(m_editor.m_allocator);
 				graph.generate(compiled);
+				if (graph.m_validation_error != m3Err_none) logWarning(src, ": not validated, ", graph.m_validation_error);
 				return m_editor.m_app.getAssetCompiler().writeCompiledResource(src, Span(compiled.data(), (u32)compiled.size()));
 			}
 		}
@@ -1,4 +1,6 @@
 #include "m3_lumix.h"
+#include "../external/m3_code.h"
+#include "../external/m3_compile.h"
 #include "../external/m3_env.h"
 
 int m3l_getGlobalCount(IM3Module module) {
@@ -8,3 +10,142 @@ int m3l_getGlobalCount(IM3Module module) {
 const char* m3l_getGlobalName(IM3Module module, int idx) {
 	return module->globals[idx].name;
 }
+
+IM3Global m3l_getGlobal(IM3Module module, uint32_t idx) {
+	return idx < module->numGlobals ? &module->globals[idx] : NULL;
+}
+
+M3Result m3l_getFunction(IM3Module module, uint32_t idx, IM3Function* function) {
+	*function = NULL;
+	IM3Function fn = Module_GetFunction(module, idx);
+	if (!fn) return m3Err_functionLookupFailed;
+	if (!fn->compiled) {
+		M3Result res = CompileFunction(fn);
+		if (res) return res;
+	}
+	*function = fn;
+	return m3Err_none;
+}
+
+uint32_t m3l_getFunctionCount(IM3Module module) {
+	return module->numFunctions;
+}
+
+M3Result m3l_compileFunction(IM3Module module, uint32_t idx) {
+	IM3Function fn = Module_GetFunction(module, idx);
+	if (!fn) return m3Err_functionLookupFailed;
+	if (!fn->wasm || fn->compiled) return m3Err_none;
+	return CompileFunction(fn);
+}
+
+M3Result m3l_linkFunction(IM3Module module, uint32_t idx, M3RawCall fn) {
+	if (!module->runtime) return m3Err_moduleNotLinked;
+	IM3Function func = Module_GetFunction(module, idx);
+	if (!func || !func->import.fieldUtf8) return m3Err_functionLookupFailed;
+	return CompileRawFunction(module, func, (const void*)fn, NULL);
+}
+
+static void* copyArray(const void* src, size_t size) {
+	return size > 0 ? m3_CopyMem(src, size) : NULL;
+}
+
+M3Result m3l_cloneModule(IM3Module module, IM3Module* clone) {
+	*clone = NULL;
+	if (module->runtime) return m3Err_moduleAlreadyLinked;
+
+	IM3Module res = m3_AllocStruct(M3Module);
+	if (!res) return m3Err_mallocFailed;
+	*res = *module;
+	// everything below is owned by the module, the rest are either values or pointers to shared data
+	res->functions = copyArray(module->functions, module->allFunctions * sizeof(M3Function));
+	res->funcTypes = copyArray(module->funcTypes, module->numFuncTypes * sizeof(IM3FuncType));
+	res->dataSegments = copyArray(module->dataSegments, module->numDataSegments * sizeof(M3DataSegment));
+	res->globals = copyArray(module->globals, module->numGlobals * sizeof(M3Global));
+	// created by m3_LoadModule
+	res->table0 = NULL;
+	res->table0Size = 0;
+	res->next = NULL;
+
+	if ((module->allFunctions && !res->functions)
+		|| (module->numFuncTypes && !res->funcTypes)
+		|| (module->numDataSegments && !res->dataSegments)
+		|| (module->numGlobals && !res->globals))
+	{
+		m3_Free(res->functions);
+		m3_Free(res->funcTypes);
+		m3_Free(res->dataSegments);
+		m3_Free(res->globals);
+		m3_Free(res);
+		return m3Err_mallocFailed;
+	}
+
+	for (uint32_t i = 0; i < res->allFunctions; ++i) {
+		// not compiled, so nothing else in the function is owned
+		res->functions[i].module = res;
+	}
+	*clone = res;
+	return m3Err_none;
+}
+
+void m3l_bakeGlobals(IM3Module parsed, IM3Module loaded) {
+	for (uint32_t i = 0; i < parsed->numGlobals && i < loaded->numGlobals; ++i) {
+		M3Global* global = &parsed->globals[i];
+		if (!global->initExpr) continue;
+		global->i64Value = loaded->globals[i].i64Value;
+		global->initExpr = NULL;
+		global->initExprSize = 0;
+	}
+}
+
+uint32_t m3l_getMaxFrameSize(IM3Module module) {
+	uint32_t max_slots = 0;
+	for (uint32_t i = 0; i < module->numFunctions; ++i) {
+		IM3Function fn = &module->functions[i];
+		if (fn->compiled && fn->maxStackSlots > max_slots) max_slots = fn->maxStackSlots;
+	}
+	return max_slots * sizeof(m3slot_t);
+}
+
+static uint64_t getCodePagesSize(IM3CodePage page) {
+	uint64_t size = 0;
+	while (page) {
+		size += sizeof(M3CodePageHeader) + page->info.numLines * sizeof(code_t);
+		page = page->info.next;
+	}
+	return size;
+}
+
+void m3l_getMemoryStats(IM3Runtime runtime, M3LMemoryStats* stats) {
+	stats->stack = runtime->stack ? runtime->numStackSlots * sizeof(m3slot_t) : 0;
+	stats->code = getCodePagesSize(runtime->pagesOpen) + getCodePagesSize(runtime->pagesFull);
+	stats->globals = 0;
+	for (IM3Module module = runtime->modules; module; module = module->next) {
+		stats->globals += module->numGlobals * sizeof(M3Global);
+	}
+	M3MemoryHeader* memory = runtime->memory.mallocated;
+	stats->linear_memory = memory ? memory->length + sizeof(M3MemoryHeader) : 0;
+}
+
+void m3l_setMemoryLimit(IM3Runtime runtime, uint32_t limit) {
+	runtime->memoryLimit = limit;
+}
+
+void m3l_setAllocationCallback(void (*callback)(size_t size)) {
+	m3_AllocationCallback = callback;
+}
+
+int m3l_mapPCToOffset(IM3Runtime runtime, const void* pc, uint32_t* offset) {
+#if d_m3RecordBacktraces
+	IM3CodePage lists[] = { runtime->pagesOpen, runtime->pagesFull };
+	for (int i = 0; i < 2; ++i) {
+		for (IM3CodePage page = lists[i]; page; page = page->info.next) {
+			if (ContainsPC(page, (pc_t)pc)) return MapPCToOffset(page, (pc_t)pc, offset);
+		}
+	}
+#endif
+	return 0;
+}
+
+int m3l_canMapPC(void) {
+	return d_m3RecordBacktraces;
+}
@@ -6,8 +6,45 @@
 extern "C" {
 #endif
 
+typedef struct M3LMemoryStats {
+	uint64_t stack;
+	uint64_t code;
+	uint64_t globals;
+	uint64_t linear_memory;
+} M3LMemoryStats;
+
 int m3l_getGlobalCount(IM3Module module);
 const char* m3l_getGlobalName(IM3Module module, int idx);
+// global `idx` in wasm index space, null if out of range
+IM3Global m3l_getGlobal(IM3Module module, uint32_t idx);
+// function `idx` in wasm index space (imports first), compiled if needed; module must be loaded
+M3Result m3l_getFunction(IM3Module module, uint32_t idx, IM3Function* function);
+uint32_t m3l_getFunctionCount(IM3Module module);
+// compiles function `idx` in wasm index space if it has a body and is not compiled yet, so compilation can be spread
+// over several calls; module must be loaded and its imports linked
+M3Result m3l_compileFunction(IM3Module module, uint32_t idx);
+// links imported function `idx` in wasm index space to `fn`, without looking it up by name
+M3Result m3l_linkFunction(IM3Module module, uint32_t idx, M3RawCall fn);
+// copy of a parsed module which is not loaded yet, so instances of the same bytecode are parsed only once per
+// environment; the copy references the same bytecode, names and function types, so it must not outlive them
+M3Result m3l_cloneModule(IM3Module module, IM3Module* clone);
+// copies initial values of globals from `loaded` to `parsed` and drops their init expressions, so modules cloned
+// from `parsed` do not compile and run an expression per global in m3_LoadModule; `loaded` must be a clone of `parsed`
+// which did not run any code yet
+void m3l_bakeGlobals(IM3Module parsed, IM3Module loaded);
+// stack in bytes needed by the largest frame of module's compiled functions, see m3_CompileModule
+uint32_t m3l_getMaxFrameSize(IM3Module module);
+// bytes allocated by the runtime, does not include the environment and memory shared with it
+void m3l_getMemoryStats(IM3Runtime runtime, M3LMemoryStats* stats);
+// hard cap on linear memory in bytes, 0 = no limit; must be set before a module is loaded into the runtime
+void m3l_setMemoryLimit(IM3Runtime runtime, uint32_t limit);
+// `callback` is called on every allocation wasm3 makes, from any thread; null to disable
+void m3l_setAllocationCallback(void (*callback)(size_t size));
+// wasm module offset of the operation at `pc`, returns 0 if `pc` is not in runtime's code;
+// always fails if wasm3 is built without d_m3RecordBacktraces
+int m3l_mapPCToOffset(IM3Runtime runtime, const void* pc, uint32_t* offset);
+// nonzero if wasm3 is built with d_m3RecordBacktraces
+int m3l_canMapPC(void);
 
 #ifdef __cplusplus
 }
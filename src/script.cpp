@@ -1,7 +1,12 @@
+#include "core/atomic.h"
+#include "core/command_line_parser.h"
 #include "core/hash_map.h"
+#include "core/job_system.h"
 #include "core/log.h"
+#include "core/os.h"
 #include "core/profiler.h"
 #include "core/stream.h"
+#include "core/string.h"
 #include "engine/engine.h"
 #include "engine/input_system.h"
 #include "engine/plugin.h"
@@ -10,297 +15,2495 @@
 #include "engine/resource_manager.h"
 #include "engine/world.h"
 #include "script.h"
+#include "script_benchmark.h"
+#include "m3_lumix.h"
 #include "../external/wasm3.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+	#include <signal.h>
+	#include <sys/time.h>
+	#include <ucontext.h>
+#endif
 
 namespace Lumix {
 
 ResourceType ScriptResource::TYPE("script");
 static const ComponentType SCRIPT_TYPE = reflection::getComponentType("script");
 
+ScriptResource::AccessSet::AccessSet(IAllocator& allocator)
+	: reads(allocator)
+	, writes(allocator)
+{}
+
+void ScriptResource::AccessSet::clear() {
+	flags = UNKNOWN;
+	reads.clear();
+	writes.clear();
+}
+
+void ScriptResource::AccessSet::addRead(StableHash property) {
+	if (reads.indexOf(property) < 0) reads.push(property);
+}
+
+void ScriptResource::AccessSet::addWrite(StableHash property) {
+	if (writes.indexOf(property) < 0) writes.push(property);
+}
+
+bool ScriptResource::AccessSet::conflicts(const AccessSet& rhs) const {
+	if ((flags | rhs.flags) & UNKNOWN) return true;
+	if ((flags & WRITE_TRANSFORM) && (rhs.flags & (READ_TRANSFORM | WRITE_TRANSFORM))) return true;
+	if ((rhs.flags & WRITE_TRANSFORM) && (flags & READ_TRANSFORM)) return true;
+	
+	for (StableHash prop : writes) {
+		if (rhs.reads.indexOf(prop) >= 0) return true;
+		if (rhs.writes.indexOf(prop) >= 0) return true;
+	}
+	for (StableHash prop : rhs.writes) {
+		if (reads.indexOf(prop) >= 0) return true;
+	}
+	return false;
+}
+
+void ScriptResource::AccessSet::serialize(OutputMemoryStream& blob) const {
+	blob.write(flags);
+	blob.write(reads.size());
+	for (StableHash prop : reads) blob.write(prop);
+	blob.write(writes.size());
+	for (StableHash prop : writes) blob.write(prop);
+}
+
+void ScriptResource::AccessSet::deserialize(InputMemoryStream& blob) {
+	clear();
+	blob.read(flags);
+	const u32 read_count = blob.read<u32>();
+	reads.reserve(read_count);
+	for (u32 i = 0; i < read_count; ++i) reads.push(blob.read<StableHash>());
+	const u32 write_count = blob.read<u32>();
+	writes.reserve(write_count);
+	for (u32 i = 0; i < write_count; ++i) writes.push(blob.read<StableHash>());
+}
+
+ScriptResource::Metadata::Metadata(IAllocator& allocator)
+	: allocator(allocator)
+	, globals(allocator)
+	, imports(allocator)
+{
+	clear();
+}
+
+void ScriptResource::Metadata::clear() {
+	valid = false;
+	for (u32& fn : entry_points) fn = NONE;
+	self_global = NONE;
+	stack_size = 0;
+	globals.clear();
+	imports.clear();
+}
+
+void ScriptResource::Metadata::serialize(OutputMemoryStream& blob) const {
+	blob.write(valid);
+	if (!valid) return;
+	blob.write(entry_points);
+	blob.write(self_global);
+	blob.write(stack_size);
+	blob.write(globals.size());
+	for (const Global& global : globals) {
+		blob.writeString(global.name.c_str());
+		blob.write(global.type);
+		blob.write(global.index);
+	}
+	blob.write(imports.size());
+	for (const Import& import : imports) {
+		blob.writeString(import.module.c_str());
+		blob.writeString(import.field.c_str());
+		blob.write(import.function);
+	}
+}
+
+void ScriptResource::Metadata::deserialize(InputMemoryStream& blob) {
+	clear();
+	if (!blob.read<bool>()) return;
+	blob.read(entry_points);
+	blob.read(self_global);
+	blob.read(stack_size);
+	const u32 global_count = blob.read<u32>();
+	globals.reserve(global_count);
+	for (u32 i = 0; i < global_count; ++i) {
+		Global& global = globals.emplace(allocator);
+		global.name = blob.readString();
+		blob.read(global.type);
+		blob.read(global.index);
+	}
+	const u32 import_count = blob.read<u32>();
+	imports.reserve(import_count);
+	for (u32 i = 0; i < import_count; ++i) {
+		Import& import = imports.emplace(allocator);
+		import.module = blob.readString();
+		import.field = blob.readString();
+		blob.read(import.function);
+	}
+	valid = true;
+}
+
+// LumixAPI imports, in ScriptFrameStats::HostAPI order
+static const char* HOST_API_NAMES[] = { "setYaw", "setPropertyFloat", "getPropertyFloat" };
+static_assert(lengthOf(HOST_API_NAMES) == ScriptFrameStats::HOST_API_COUNT);
+
+// subset of WASI for scripts compiled from C/C++/Rust, implemented on top of the engine, see ScriptModuleImpl::linkWASI
+static const char* WASI_MODULE = "wasi_snapshot_preview1";
+static const char* WASI_NAMES[] = { "fd_write", "clock_time_get", "random_get", "proc_exit" };
+static const char* WASI_SIGNATURES[] = { "i(i*i*)", "i(iI*)", "i(*i)", "v(i)" };
+static_assert(lengthOf(WASI_NAMES) == lengthOf(WASI_SIGNATURES));
+
+// resources are per path, but their compiled content is deduplicated by hash, so paths compiled to identical
+// scripts, e.g. duplicated prefabs or templates copied per level, hold the bytecode only once
+struct ScriptManager : ResourceManager {
+	ScriptManager(IAllocator& allocator)
+		: ResourceManager(allocator)
+		, m_shared_data(allocator)
+	{}
+
+	~ScriptManager() {
+		ASSERT(m_shared_data.empty());
+	}
+
+	Resource* createResource(const Path& path) override {
+		return LUMIX_NEW(m_allocator, ScriptResource)(path, *this, m_allocator);
+	}
+
+	void destroyResource(Resource& resource) override {
+		LUMIX_DELETE(m_allocator, &resource);
+	}
+
+	// `content` is copied only if no other resource has identical content; `hash` is the hash of its wasm module,
+	// files differing outside of the module are compared and not shared
+	ScriptResource::SharedData* share(Span<const u8> content, StableHash hash) {
+		ScriptResource::SharedData* existing = find(hash);
+		if (existing && isSame(*existing, content)) return ref(existing);
+
+		ScriptResource::SharedData* data = add(hash, !existing);
+		data->content.reserve(content.length());
+		data->content.write(content.begin(), content.length());
+		return data;
+	}
+
+	ScriptResource::SharedData* share(OutputMemoryStream&& content, StableHash hash) {
+		ScriptResource::SharedData* existing = find(hash);
+		if (existing && isSame(*existing, Span(content.data(), (u32)content.size()))) return ref(existing);
+
+		ScriptResource::SharedData* data = add(hash, !existing);
+		data->content = static_cast<OutputMemoryStream&&>(content);
+		return data;
+	}
+
+	void release(ScriptResource::SharedData* data) {
+		ASSERT(data->ref_count > 0);
+		--data->ref_count;
+		if (data->ref_count > 0) return;
+
+		if (find(data->hash) == data) m_shared_data.erase(data->hash);
+		LUMIX_DELETE(m_allocator, data);
+	}
+
+	// changes whenever bytecode of any script is loaded or released, so modules hot reload only if needed
+	u32 getDataGeneration() const { return m_data_generation; }
+	void onDataChanged() { ++m_data_generation; }
+
+private:
+	ScriptResource::SharedData* find(StableHash hash) {
+		auto iter = m_shared_data.find(hash);
+		return iter.isValid() ? iter.value() : nullptr;
+	}
+
+	// a hash collision must not make a resource run another resource's code, nor use its metadata
+	static bool isSame(const ScriptResource::SharedData& data, Span<const u8> content) {
+		return data.content.size() == content.length() && memcmp(data.content.data(), content.begin(), content.length()) == 0;
+	}
+
+	static ScriptResource::SharedData* ref(ScriptResource::SharedData* data) {
+		++data->ref_count;
+		return data;
+	}
+
+	// on collision or different metadata, the new data is not shared and the map keeps pointing to the first one
+	ScriptResource::SharedData* add(StableHash hash, bool shared) {
+		ScriptResource::SharedData* data = LUMIX_NEW(m_allocator, ScriptResource::SharedData)(m_allocator);
+		data->hash = hash;
+		data->ref_count = 1;
+		if (shared) m_shared_data.insert(hash, data);
+		return data;
+	}
+
+	HashMap<StableHash, ScriptResource::SharedData*> m_shared_data;
+	u32 m_data_generation = 0;
+};
+
+void ScriptResource::releaseData() {
+	if (!m_data) return;
+	ScriptManager& manager = static_cast<ScriptManager&>(getResourceManager());
+	manager.release(m_data);
+	manager.onDataChanged();
+	m_data = nullptr;
+	m_bytecode = {};
+}
+
 void ScriptResource::unload() {
-	m_bytecode.clear();
+	m_access_set.clear();
+	m_metadata.clear();
+	m_validated = false;
+	releaseData();
+	m_node_map.clear();
 }
 
 ScriptResource::ScriptResource(const Path& path, ResourceManager& resource_manager, IAllocator& allocator)
 	: Resource(path, resource_manager, allocator)
-	, m_bytecode(allocator)
+	, m_access_set(allocator)
+	, m_metadata(allocator)
+	, m_node_map(allocator)
 	, m_allocator(allocator)
 {}
 
-bool ScriptResource::load(Span<const u8> mem) {
-	InputMemoryStream blob(mem);
+ScriptResource::~ScriptResource() {
+	releaseData();
+}
+
+static u32 readULEB128(InputMemoryStream& blob) {
+	u32 value = 0;
+	u32 shift = 0;
+	for (;;) {
+		const u8 byte = blob.read<u8>();
+		value |= u32(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0 || shift >= 28) return value;
+		shift += 7;
+	}
+}
+
+// finds NODE_MAP_SECTION among wasm sections, other sections are skipped
+static void loadNodeMap(Span<const u8> wasm, Array<ScriptResource::NodeCodeRange>& map) {
+	map.clear();
+	if (wasm.length() < 8) return;
+	InputMemoryStream blob(wasm);
+	blob.skip(8); // magic, version
+	while (blob.remaining() > 0) {
+		const u8 section = blob.read<u8>();
+		const u32 size = readULEB128(blob);
+		if (size > blob.remaining()) return;
+		const u64 section_end = blob.getPosition() + size;
+		if (section == 0) {
+			const u32 name_len = readULEB128(blob);
+			if (name_len > blob.remaining()) return;
+			const char* name = (const char*)blob.skip(name_len);
+			if (equalStrings(StringView(name, name_len), ScriptResource::NODE_MAP_SECTION)) {
+				const u32 count = readULEB128(blob);
+				map.reserve(count);
+				for (u32 i = 0; i < count; ++i) {
+					ScriptResource::NodeCodeRange& range = map.emplace();
+					range.offset = readULEB128(blob);
+					range.node = readULEB128(blob);
+				}
+				return;
+			}
+		}
+		blob.setPosition(section_end);
+	}
+}
+
+u32 ScriptResource::findNode(u32 offset) const {
+	// last range starting at or before `offset`
+	u32 left = 0;
+	u32 right = m_node_map.size();
+	while (left < right) {
+		const u32 mid = (left + right) / 2;
+		if (m_node_map[mid].offset <= offset) left = mid + 1;
+		else right = mid;
+	}
+	return left > 0 ? m_node_map[left - 1].node : NodeCodeRange::NO_NODE;
+}
+
+static m3ApiRawFunction(validationStub) {
+	m3ApiTrap(m3Err_trapUnreachable);
+}
+
+u32 ScriptResource::getStackSize() const {
+	return m_validated && m_metadata.stack_size ? m_metadata.stack_size : Metadata::DEFAULT_STACK_SIZE;
+}
+
+M3Result ScriptResource::validate(Span<const u8> wasm, u32 stack_size, u32* max_frame_size) {
+	IM3Environment env = m3_NewEnvironment();
+	if (!env) return m3Err_mallocFailed;
+	IM3Runtime runtime = m3_NewRuntime(env, stack_size, nullptr);
+	if (!runtime) {
+		m3_FreeEnvironment(env);
+		return m3Err_mallocFailed;
+	}
+
+	IM3Module module;
+	M3Result res = m3_ParseModule(env, &module, wasm.begin(), wasm.length());
+	if (res == m3Err_none) {
+		res = m3_LoadModule(runtime, module);
+		if (res != m3Err_none) m3_FreeModule(module);
+		else {
+			// calls are compiled only if their target is linked, the stubs are never called
+			for (const char* name : HOST_API_NAMES) {
+				const M3Result link_res = m3_LinkRawFunction(module, "LumixAPI", name, nullptr, &validationStub);
+				if (link_res != m3Err_none && link_res != m3Err_functionLookupFailed) res = link_res;
+			}
+			for (u32 i = 0; i < lengthOf(WASI_NAMES); ++i) {
+				const M3Result link_res = m3_LinkRawFunction(module, WASI_MODULE, WASI_NAMES[i], WASI_SIGNATURES[i], &validationStub);
+				if (link_res != m3Err_none && link_res != m3Err_functionLookupFailed) res = link_res;
+			}
+			if (res == m3Err_none) res = m3_CompileModule(module);
+		}
+		if (res == m3Err_none) {
+			const u32 frame_size = m3l_getMaxFrameSize(module);
+			if (max_frame_size) *max_frame_size = frame_size;
+			if (frame_size >= stack_size) res = m3Err_trapStackOverflow;
+		}
+	}
+
+	m3_FreeRuntime(runtime);
+	m3_FreeEnvironment(env);
+	return res;
+}
+
+// `content` is the whole compiled file
+bool ScriptResource::parseData(Span<const u8> content, u32& module_offset, StableHash& module_hash) {
+	InputMemoryStream blob(content);
 	Header header;
 	blob.read(header);
 	if (header.magic != Header::MAGIC) return false;
 	if (header.version > Version::LAST) return false;
 
-	u32 bytecode_size = u32(blob.remaining());
-	m_bytecode.resize(bytecode_size);
-	blob.read(m_bytecode.getMutableData(), bytecode_size);
+	if (header.version > Version::ACCESS_SET) m_access_set.deserialize(blob);
+	else m_access_set.clear();
+
+	if (header.version > Version::METADATA) {
+		m_metadata.deserialize(blob);
+		for (Metadata::Import& import : m_metadata.imports) {
+			if (!equalStrings(import.module.c_str(), "LumixAPI")) continue;
+			for (u32 i = 0; i < lengthOf(HOST_API_NAMES); ++i) {
+				if (equalStrings(import.field.c_str(), HOST_API_NAMES[i])) import.api = i;
+			}
+		}
+	}
+	else m_metadata.clear();
+
+	Validation validation;
+	if (header.version > Version::VALIDATION) blob.read(validation);
+
+	// the only hash of the content, it's also the key ScriptManager shares the content by
+	module_offset = (u32)blob.getPosition();
+	module_hash = StableHash(content.begin() + module_offset, u32(blob.remaining()));
+	m_validated = validation.validated && validation.hash == module_hash;
 	return true;
 }
 
-Script::Script(Script&& script)
-{
-	m_runtime = script.m_runtime;
-	m_module = script.m_module;
-	m_resource = script.m_resource;
-	m_init_failed = script.m_init_failed;
+void ScriptResource::setData(SharedData* data, u32 module_offset) {
+	m_data = data;
+	m_bytecode = Span(m_data->content.data() + module_offset, u32(m_data->content.size() - module_offset));
+	loadNodeMap(m_bytecode, m_node_map);
+	++m_generation;
+	static_cast<ScriptManager&>(getResourceManager()).onDataChanged();
+}
+
+bool ScriptResource::load(Span<const u8> mem) {
+	// the file system owns `mem` and frees it once we return, so this is the only copy, made only if no other
+	// resource has identical content; the bytecode is not copied again and wasm3 parses it in place
+	releaseData();
+	u32 module_offset;
+	StableHash module_hash;
+	if (!parseData(mem, module_offset, module_hash)) return false;
+	setData(static_cast<ScriptManager&>(getResourceManager()).share(mem, module_hash), module_offset);
+	return true;
+}
+
+bool ScriptResource::create(Span<const u8> compiled) {
+	const bool res = load(compiled);
+	onCreated(res ? State::READY : State::FAILURE);
+	return res;
+}
+
+bool ScriptResource::create(OutputMemoryStream&& compiled) {
+	releaseData();
+	u32 module_offset;
+	StableHash module_hash;
+	const bool res = parseData(Span(compiled.data(), (u32)compiled.size()), module_offset, module_hash);
+	if (res) setData(static_cast<ScriptManager&>(getResourceManager()).share(static_cast<OutputMemoryStream&&>(compiled), module_hash), module_offset);
+	onCreated(res ? State::READY : State::FAILURE);
+	return res;
+}
+
+Script::Script(Script&& script)
+{
+	m_runtime = script.m_runtime;
+	m_module = script.m_module;
+	m_resource = script.m_resource;
+	m_init_failed = script.m_init_failed;
+	m_update_fn = script.m_update_fn;
+	m_mouse_move_fn = script.m_mouse_move_fn;
+	m_key_event_fn = script.m_key_event_fn;
+	m_start_fn = script.m_start_fn;
+	m_self_global = script.m_self_global;
+	m_snapshot_offset = script.m_snapshot_offset;
+	m_snapshot_count = script.m_snapshot_count;
+	m_load_stage = script.m_load_stage;
+	m_load_function = script.m_load_function;
+	m_partition = script.m_partition;
+	m_generation = script.m_generation;
+
+	script.m_resource = nullptr;
+	script.m_runtime = nullptr;
+	script.m_module = nullptr;
+	script.m_update_fn = nullptr;
+	script.m_mouse_move_fn = nullptr;
+	script.m_key_event_fn = nullptr;
+	script.m_start_fn = nullptr;
+	script.m_self_global = nullptr;
+	script.m_load_stage = LoadStage::NONE;
+}
+
+Script::~Script() {
+	if (m_resource) m_resource->decRefCount();
+	ASSERT(!m_runtime);
+	ASSERT(!m_module);
+}
+
+// write made by a script in snapshot mode, applied after the update phase
+struct DeferredWrite {
+	enum class Type : u32 {
+		SET_YAW,
+		SET_PROPERTY_FLOAT
+	};
+
+	Type type;
+	EntityRef entity;
+	StableHash property;
+	float value;
+};
+
+struct PropertySnapshot {
+	EntityRef entity;
+	StableHash property;
+	float value;
+};
+
+// begin and end of a call into a script or of a host API call, see ScriptModule::traceExecution
+struct TraceEvent {
+	const char* name;
+	EntityRef entity;
+	const ScriptResource* resource;
+	u32 thread;
+	u64 begin;
+	u64 end;
+};
+
+// all running instances of a single resource, these are always updated on the same thread
+struct ScriptGroup {
+	ScriptGroup(IAllocator& allocator)
+		: scripts(allocator)
+		, entities(allocator)
+		, writes(allocator)
+		, trace(allocator)
+		, wasi_output(allocator)
+	{}
+
+	ScriptResource* resource = nullptr;
+	Array<Script*> scripts;
+	// entity of each script in `scripts`
+	Array<EntityRef> entities;
+	Array<DeferredWrite> writes;
+	Array<TraceEvent> trace;
+	// WASI stdout and stderr of this group's scripts, flushed to the log at the end of the frame
+	OutputMemoryStream wasi_output;
+	u32 host_calls[ScriptFrameStats::HOST_API_COUNT];
+	u32 updated = 0;
+	// time of updates skipped by the frame budget watchdog, passed to the next update
+	float skipped_time = 0;
+	u32 level = 0;
+};
+
+// instances of a resource created ahead of time, see ScriptModule::reservePool
+struct ScriptPool {
+	ScriptPool(IAllocator& allocator) : instances(allocator) {}
+
+	ScriptResource* resource = nullptr;
+	u32 size = 0;
+	// filled at once in the next update, afterwards spawned instances are replaced only within the instantiation budget
+	bool needs_fill = true;
+	Array<Script> instances;
+	// replacement of a spawned instance, created step by step, moved to `instances` once it's ready
+	Script refill;
+};
+
+// parsed but not loaded module of a resource, instances load a copy of it instead of parsing the bytecode again;
+// see m3l_cloneModule
+struct ParsedScript {
+	IM3Module module;
+	// ScriptResource::m_generation the module was parsed from
+	u32 generation;
+	// see m3l_bakeGlobals
+	bool globals_baked;
+};
+
+// input events dispatched to scripts, see ScriptModule::recordInput;
+// the header is followed by one entry per update: u16 event count and the events, each starting with RecordedEventType
+struct InputRecordingHeader {
+	static constexpr u32 MAGIC = '_LVI';
+	static constexpr u32 VERSION = 0;
+
+	u32 magic = MAGIC;
+	u32 version = VERSION;
+	u32 frames = 0;
+};
+
+enum class RecordedEventType : u8 {
+	KEY,		// u32 key_id
+	MOUSE_MOVE	// float x, float y
+};
+
+// allocations made during the script phase while allocation tracking is on
+static AtomicI32 g_phase_allocations(0);
+
+static void countWasm3Allocation(size_t size) {
+	g_phase_allocations.inc();
+}
+
+// forwards to `parent` and counts allocations while `tracking` is set, see ScriptModule::setAllocationTracking
+struct CountingAllocator final : IAllocator {
+	CountingAllocator(IAllocator& parent) : parent(parent) {}
+
+	void* allocate(size_t size, size_t align) override {
+		if (tracking) g_phase_allocations.inc();
+		return parent.allocate(size, align);
+	}
+
+	void deallocate(void* ptr) override { parent.deallocate(ptr); }
+
+	void* reallocate(void* ptr, size_t new_size, size_t old_size, size_t align) override {
+		if (tracking && new_size > 0) g_phase_allocations.inc();
+		return parent.reallocate(ptr, new_size, old_size, align);
+	}
+
+	IAllocator& parent;
+	bool tracking = false;
+};
+
+// script and group being updated on this thread, null outside of the update phase
+static thread_local ScriptGroup* t_current_group = nullptr;
+static thread_local const Script* t_current_script = nullptr;
+// where trace events of this thread go, null if tracing is disabled
+static thread_local Array<TraceEvent>* t_trace = nullptr;
+// resource of the innermost traced call into a script, host calls are attributed to it
+static thread_local const ScriptResource* t_trace_resource = nullptr;
+
+// adds its lifetime in milliseconds to `ms`
+struct TimeScope {
+	TimeScope(float& ms) : ms(ms) {}
+	~TimeScope() { ms += timer.getTimeSinceStart() * 1000; }
+
+	float& ms;
+	os::Timer timer;
+};
+
+// steps of the frame budget watchdog, see ScriptModule::setFrameBudget; each step includes the previous ones
+enum Degradation : u32 {
+	DEGRADATION_NONE,
+	DEGRADATION_LOW_PRIORITY_TICK_RATE,
+	DEGRADATION_DEFERRED_INSTANTIATION,
+	DEGRADATION_SKIP_LOW_PRIORITY_EVENTS,
+
+	DEGRADATION_COUNT
+};
+
+static const char* DEGRADATION_NAMES[] = {
+	"none",
+	"low priority scripts updated less often",
+	"instantiation spread over frames",
+	"event handlers of low priority scripts skipped"
+};
+static_assert(lengthOf(DEGRADATION_NAMES) == DEGRADATION_COUNT);
+
+static constexpr u32 OVER_BUDGET_FRAMES = 5;
+static constexpr u32 HEADROOM_FRAMES = 60;
+// fraction of the budget a frame must fit in to count as headroom
+static constexpr float HEADROOM = 0.75f;
+static constexpr u32 LOW_PRIORITY_TICK_INTERVAL = 4;
+static constexpr u32 DEFERRED_INSTANTIATIONS_PER_FRAME = 16;
+
+// what the watchdog did since its last report
+struct DegradationStats {
+	u32 over_budget_frames = 0;
+	float worst_ms = 0;
+	u32 skipped_updates = 0;
+	u32 deferred_instantiations = 0;
+	u32 skipped_events = 0;
+};
+
+// host call counters of this thread, see ScriptFrameStats
+static thread_local u32* t_host_calls = nullptr;
+
+// WASI output buffer of this thread, ScriptGroup::wasi_output on workers; null on the main thread
+static thread_local OutputMemoryStream* t_wasi_output = nullptr;
+// state of the WASI random_get generator of this thread
+static thread_local u64 t_wasi_random = 0;
+// max WASI output buffered per frame in a single buffer, the rest is dropped
+static constexpr u32 WASI_OUTPUT_LIMIT = 64 * 1024;
+static constexpr u32 WASI_ERRNO_SUCCESS = 0;
+static constexpr u32 WASI_ERRNO_BADF = 8;
+static constexpr u32 WASI_ERRNO_INVAL = 28;
+
+// sampling profiler, see ScriptModule::profileExecution; samples are written by the SIGPROF handler on whichever
+// thread is running a script and read on the main thread after the update phase, when no script is running
+struct ProfilerSample {
+	IM3Runtime runtime;
+	const ScriptResource* resource;
+	const void* pc;
+};
+
+// samples attributed to a graph node, node is NodeCodeRange::NO_NODE if the sample could not be mapped
+struct NodeSamples {
+	Path resource;
+	u32 node;
+	u32 samples;
+};
+
+static constexpr u32 PROFILER_INTERVAL_US = 1000;
+static constexpr i32 MAX_PROFILER_SAMPLES = 64 * 1024;
+static ProfilerSample g_profiler_samples[MAX_PROFILER_SAMPLES];
+static AtomicI32 g_profiler_sample_count(0);
+// script executed on this thread, null outside of calls into scripts; read by the SIGPROF handler, so it's initial-exec,
+// otherwise the handler would go through __tls_get_addr, which is not async-signal-safe in a dlopen'ed plugin and
+// allocates the thread's block on first access, e.g. when the signal lands on a thread which never ran a script
+#ifdef __linux__
+	static thread_local const Script* t_profiled_script __attribute__((tls_model("initial-exec"))) = nullptr;
+#else
+	static thread_local const Script* t_profiled_script = nullptr;
+#endif
+
+// marks the script as running on this thread for the profiler
+struct ProfiledCall {
+	ProfiledCall(const Script& script) : prev(t_profiled_script) { t_profiled_script = &script; }
+	~ProfiledCall() { t_profiled_script = prev; }
+
+	const Script* prev;
+};
+
+#ifdef __linux__
+	static void onProfilerSignal(int, siginfo_t*, void* context) {
+		const Script* script = t_profiled_script;
+		if (!script) return;
+
+		// wasm3 operations get `_pc` in the first argument register and pass it on to the next operation;
+		// if the register holds something else, e.g. in a host function, the sample is not mapped to a node
+		const ucontext_t* uc = (const ucontext_t*)context;
+		#if defined(__x86_64__)
+			const void* pc = (const void*)uc->uc_mcontext.gregs[REG_RDI];
+		#elif defined(__aarch64__)
+			const void* pc = (const void*)uc->uc_mcontext.regs[0];
+		#else
+			const void* pc = nullptr;
+		#endif
+
+		i32 idx;
+		do {
+			idx = g_profiler_sample_count;
+			if (idx >= MAX_PROFILER_SAMPLES) return;
+		} while (!g_profiler_sample_count.compareExchange(idx + 1, idx));
+		g_profiler_samples[idx] = { script->m_runtime, script->m_resource, pc };
+	}
+
+	static void startProfilerTimer(u32 interval_us) {
+		struct sigaction action = {};
+		action.sa_sigaction = onProfilerSignal;
+		action.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGPROF, &action, nullptr);
+
+		itimerval timer = {};
+		timer.it_interval.tv_usec = interval_us;
+		timer.it_value.tv_usec = interval_us;
+		setitimer(ITIMER_PROF, &timer, nullptr);
+	}
+
+	static void stopProfilerTimer() {
+		itimerval timer = {};
+		setitimer(ITIMER_PROF, &timer, nullptr);
+		signal(SIGPROF, SIG_IGN);
+	}
+#else
+	static void startProfilerTimer(u32) { logError("Script sampling profiler is supported only on Linux"); }
+	static void stopProfilerTimer() {}
+#endif
+
+// records a trace event spanning its lifetime if tracing is enabled on this thread
+struct TraceScope {
+	TraceScope(const char* name, EntityRef entity, const ScriptResource* resource = nullptr)
+		: trace(t_trace)
+		, prev_resource(t_trace_resource)
+	{
+		if (!trace) return;
+		if (resource) t_trace_resource = resource;
+		// events are referenced by index, since nested scopes can grow the array
+		index = trace->size();
+		TraceEvent& event = trace->emplace();
+		event.name = name;
+		event.entity = entity;
+		event.resource = t_trace_resource;
+		event.thread = (u32)os::getCurrentThreadID();
+		event.begin = os::Timer::getRawTimestamp();
+	}
+
+	~TraceScope() {
+		if (!trace) return;
+		(*trace)[index].end = os::Timer::getRawTimestamp();
+		t_trace_resource = prev_resource;
+	}
+
+	Array<TraceEvent>* trace;
+	const ScriptResource* prev_resource;
+	u32 index = 0;
+};
+
+// like ScriptResource::Version, data written before an entry was added has a version <= the entry
+enum class ScriptModuleVersion : i32 {
+	FIRST,
+	// resource paths are deduplicated, instances can have saved state
+	PATH_TABLE,
+	// partition of each script and state of inactive partitions
+	PARTITIONS,
+
+	LAST
+};
+
+// range of ScriptModuleImpl::m_saved_globals
+struct SavedGlobals {
+	u32 offset;
+	u32 size;
+};
+
+// resource index of scripts without a resource in serialized world
+static constexpr u32 NO_RESOURCE = 0xffFFffFF;
+
+struct ScriptModuleImpl : ScriptModule {
+	ScriptModuleImpl(ISystem& system, Engine& engine, World& world, IAllocator& allocator)
+		: m_system(system)
+		, m_world(world)
+		, m_engine(engine)
+		, m_counting_allocator(allocator)
+		, m_allocator(m_counting_allocator)
+		, m_scripts(m_allocator)
+		, m_mouse_move_scripts(m_allocator)
+		, m_key_input_scripts(m_allocator)
+		, m_groups(m_allocator)
+		, m_group_indices(m_allocator)
+		, m_level_groups(m_allocator)
+		, m_snapshot(m_allocator)
+		, m_pools(m_allocator)
+		, m_reloads(m_allocator)
+		, m_reload_state(m_allocator)
+		, m_parsed_scripts(m_allocator)
+		, m_configured_resources(m_allocator)
+		, m_input_recording(m_allocator)
+		, m_input_replay(m_allocator)
+		, m_trace(m_allocator)
+		, m_trace_json(m_allocator)
+		, m_profile(m_allocator)
+		, m_saved_globals(m_allocator)
+		, m_saved_globals_ranges(m_allocator)
+		, m_inactive_partitions(m_allocator)
+		, m_wasi_output(m_allocator)
+	{}
+
+	~ScriptModuleImpl() {
+		for (Script& script : m_scripts) freeRuntime(script);
+		clearPools();
+		clearReloads();
+		for (ScriptPool& pool : m_pools) pool.resource->decRefCount();
+		for (ScriptResource* res : m_configured_resources) res->decRefCount();
+		clearParsedScripts();
+		if (m_environment) m3_FreeEnvironment(m_environment);
+	}
+
+	const char* getName() const override { return "script"; }
+
+	void setParallelUpdate(bool enable) override { m_parallel_update = enable; }
+	void setSnapshotMode(bool enable) override { m_snapshot_mode = enable; }
+
+	void setAllocationTracking(bool enable) override {
+		m_allocation_tracking = enable;
+		m_tracked_frames = 0;
+		m_phase_allocations = 0;
+	}
+
+	u32 getPhaseAllocations() const override { return m_phase_allocations; }
+
+	void recordInput(const char* path) override {
+		copyString(m_input_recording_path, path);
+		m_input_recording.clear();
+		m_recorded_frames = 0;
+	}
+
+	bool replayInput(const char* path, float time_step) override {
+		m_input_replay.clear();
+		m_replay_time_step = time_step;
+
+		os::InputFile file;
+		if (!file.open(path)) {
+			logError("Failed to open input recording ", path);
+			return false;
+		}
+		m_input_replay.resize(file.size());
+		const bool read = file.read(m_input_replay.getMutableData(), m_input_replay.size());
+		file.close();
+		
+		InputRecordingHeader header;
+		if (!read || m_input_replay.size() < sizeof(header)) {
+			logError("Failed to read input recording ", path);
+			m_input_replay.clear();
+			return false;
+		}
+		memcpy(&header, m_input_replay.data(), sizeof(header));
+		if (header.magic != InputRecordingHeader::MAGIC || header.version > InputRecordingHeader::VERSION) {
+			logError(path, " is not a supported input recording");
+			m_input_replay.clear();
+			return false;
+		}
+		m_replay_frames = header.frames;
+		rewindReplay();
+		return true;
+	}
+
+	void profileExecution(const char* path) override {
+		copyString(m_profile_path, path);
+		m_profile.clear();
+		if (!m3l_canMapPC()) logWarning("Built without --visualscript-profiler, samples will not be mapped to nodes");
+	}
+
+	void traceExecution(const char* path) override {
+		copyString(m_trace_path, path);
+		m_trace.clear();
+		m_trace_json.clear();
+	}
+
+	bool isReplayingInput() const override { return !m_input_replay.empty() && m_replayed_frames < m_replay_frames; }
+
+	void rewindReplay() {
+		m_replay_offset = sizeof(InputRecordingHeader);
+		m_replayed_frames = 0;
+	}
+
+	bool saveInputRecording() {
+		InputRecordingHeader header;
+		header.frames = m_recorded_frames;
+
+		os::OutputFile file;
+		if (!file.open(m_input_recording_path)) {
+			logError("Failed to create ", m_input_recording_path);
+			return false;
+		}
+		bool success = file.write(&header, sizeof(header));
+		success = file.write(m_input_recording.data(), m_input_recording.size()) && success;
+		file.close();
+		if (!success) logError("Failed to write ", m_input_recording_path);
+		else logInfo("Script input recorded to ", m_input_recording_path, ", ", m_recorded_frames, " frames");
+		return success;
+	}
+
+	i32 getVersion() const override { return (i32)ScriptModuleVersion::LAST; }
+
+	// named globals except `self`, by name so they survive recompilation of the script; `script` must be READY
+	static void saveGlobals(const Script& script, OutputMemoryStream& blob) {
+		ASSERT(script.m_load_stage == Script::LoadStage::READY);
+		const u64 count_offset = blob.size();
+		u32 count = 0;
+		blob.write(count);
+
+		const int global_count = m3l_getGlobalCount(script.m_module);
+		for (int i = 0; i < global_count; ++i) {
+			const char* name = m3l_getGlobalName(script.m_module, i);
+			if (!name || equalStrings(name, "self")) continue;
+
+			M3TaggedValue value = {};
+			if (m3_GetGlobal(m3l_getGlobal(script.m_module, i), &value) != m3Err_none) continue;
+			blob.writeString(name);
+			blob.write(value.type);
+			blob.write(value.value);
+			++count;
+		}
+		memcpy(blob.getMutableData() + count_offset, &count, sizeof(count));
+	}
+
+	// `state` is saveGlobals output, restored when the instance of `entity` starts
+	void addSavedGlobals(EntityRef entity, const void* state, u32 size) {
+		m_saved_globals_ranges.insert(entity, { (u32)m_saved_globals.size(), size });
+		m_saved_globals.write(state, size);
+		m_saved_globals_live += size;
+	}
+
+	// ranges of scripts which never start stay, so the buffer is compacted instead of growing with each
+	// partition activation once most of it is unused
+	void eraseSavedGlobals(EntityRef entity) {
+		auto iter = m_saved_globals_ranges.find(entity);
+		if (!iter.isValid()) return;
+		m_saved_globals_live -= iter.value().size;
+		m_saved_globals_ranges.erase(iter);
+		if (m_saved_globals_ranges.empty()) {
+			m_saved_globals.clear();
+			m_saved_globals_live = 0;
+			return;
+		}
+		if (m_saved_globals.size() <= 2 * m_saved_globals_live) return;
+
+		OutputMemoryStream compacted(m_allocator);
+		compacted.reserve(m_saved_globals_live);
+		for (SavedGlobals& range : m_saved_globals_ranges) {
+			const u32 offset = (u32)compacted.size();
+			compacted.write(m_saved_globals.data() + range.offset, range.size);
+			range.offset = offset;
+		}
+		m_saved_globals = static_cast<OutputMemoryStream&&>(compacted);
+	}
+
+	// counterpart of saveGlobals, globals which no longer exist or changed type are skipped
+	static void restoreGlobals(Script& script, InputMemoryStream& blob) {
+		const u32 count = blob.read<u32>();
+		for (u32 i = 0; i < count; ++i) {
+			const char* name = blob.readString();
+			M3TaggedValue value;
+			blob.read(value.type);
+			blob.read(value.value);
+			IM3Global global = m3_FindGlobal(script.m_module, name);
+			if (!global || m3_GetGlobalType(global) != value.type) continue;
+			m3_SetGlobal(global, &value);
+		}
+	}
+
+	// unique resource paths first, then (entity, resource index, partition, state) sorted by entity,
+	// so each path is written and loaded only once; state is saved only for running instances,
+	// instances in inactive partitions have it in the partition's blob, which follow the entities
+	void serialize(OutputMemoryStream& blob) override {
+		Array<ScriptResource*> resources(m_allocator);
+		HashMap<ScriptResource*, u32> resource_indices(m_allocator);
+		Array<EntityRef> entities(m_allocator);
+		entities.reserve(m_scripts.size());
+		for (auto iter = m_scripts.begin(), end = m_scripts.end(); iter != end; ++iter) {
+			entities.push(iter.key());
+			ScriptResource* res = iter.value().m_resource;
+			if (!res || resource_indices.find(res).isValid()) continue;
+			resource_indices.insert(res, (u32)resources.size());
+			resources.push(res);
+		}
+		qsort(entities.begin(), entities.size(), sizeof(entities[0]), [](const void* a, const void* b){
+			return static_cast<const EntityRef*>(a)->index - static_cast<const EntityRef*>(b)->index;
+		});
+
+		blob.write((u32)resources.size());
+		for (ScriptResource* res : resources) blob.writeString(res->getPath().c_str());
+
+		OutputMemoryStream state(m_allocator);
+		blob.write((u32)entities.size());
+		for (EntityRef e : entities) {
+			const Script& script = m_scripts[e];
+			blob.write(e);
+			blob.write(script.m_resource ? resource_indices[script.m_resource] : NO_RESOURCE);
+			blob.write(script.m_partition);
+
+			state.clear();
+			if (script.m_load_stage == Script::LoadStage::READY) saveGlobals(script, state);
+			blob.write((u32)state.size());
+			blob.write(state.data(), state.size());
+		}
+
+		blob.write(m_inactive_partitions.size());
+		for (auto iter = m_inactive_partitions.begin(), end = m_inactive_partitions.end(); iter != end; ++iter) {
+			blob.write(iter.key());
+			blob.write((u32)iter.value().size());
+			blob.write(iter.value().data(), iter.value().size());
+		}
+	}
+
+	void deserialize(InputMemoryStream& blob, const EntityMap& entity_map, i32 version) override {
+		ResourceManagerHub& rm = m_engine.getResourceManager();
+		if (version <= (i32)ScriptModuleVersion::PATH_TABLE) {
+			u32 count;
+			blob.read(count);
+			for (u32 i = 0; i < count; ++i) {
+				EntityRef e;
+				blob.read(e);
+				e = entity_map.get(e);
+				const char* path = blob.readString();
+				Script script;
+				script.m_resource = path[0] ? rm.load<ScriptResource>(Path(path)) : nullptr;
+				m_scripts.insert(e, static_cast<Script&&>(script));
+				m_world.onComponentCreated(e, SCRIPT_TYPE, this);
+			}
+			return;
+		}
+
+		const u32 resource_count = blob.read<u32>();
+		Array<ScriptResource*> resources(m_allocator);
+		resources.reserve(resource_count);
+		for (u32 i = 0; i < resource_count; ++i) resources.push(rm.load<ScriptResource>(Path(blob.readString())));
+
+		const u32 count = blob.read<u32>();
+		for (u32 i = 0; i < count; ++i) {
+			EntityRef e;
+			blob.read(e);
+			e = entity_map.get(e);
+			const u32 resource_idx = blob.read<u32>();
+			Script script;
+			if (resource_idx < resource_count) {
+				script.m_resource = resources[resource_idx];
+				script.m_resource->incRefCount();
+			}
+			else if (resource_idx != NO_RESOURCE) logError("Script resource index ", resource_idx, " out of range, the script has no resource");
+			if (version > (i32)ScriptModuleVersion::PARTITIONS) blob.read(script.m_partition);
+			m_scripts.insert(e, static_cast<Script&&>(script));
+			m_world.onComponentCreated(e, SCRIPT_TYPE, this);
+
+			const u32 state_size = blob.read<u32>();
+			if (state_size == 0) continue;
+			addSavedGlobals(e, blob.skip(state_size), state_size);
+		}
+		// scripts hold their own references
+		for (ScriptResource* res : resources) res->decRefCount();
+		if (version <= (i32)ScriptModuleVersion::PARTITIONS) return;
+
+		const u32 partition_count = blob.read<u32>();
+		for (u32 i = 0; i < partition_count; ++i) {
+			const u32 partition = blob.read<u32>();
+			const u32 size = blob.read<u32>();
+			InputMemoryStream partition_blob(blob.skip(size), size);
+			if (!m_inactive_partitions.find(partition).isValid()) m_inactive_partitions.insert(partition, OutputMemoryStream(m_allocator));
+			OutputMemoryStream& partition_state = m_inactive_partitions[partition];
+			// entities are remapped
+			while (partition_blob.getPosition() < size) {
+				EntityRef e;
+				partition_blob.read(e);
+				const u32 state_size = partition_blob.read<u32>();
+				partition_state.write(entity_map.get(e));
+				partition_state.write(state_size);
+				partition_state.write(partition_blob.skip(state_size), state_size);
+			}
+		}
+	}
+
+	void setScriptPartition(EntityRef entity, u32 partition) override {
+		Script& script = m_scripts[entity];
+		if (script.m_partition == partition) return;
+		auto old_iter = m_inactive_partitions.find(script.m_partition);
+		auto iter = m_inactive_partitions.find(partition);
+		script.m_partition = partition;
+		if (old_iter.isValid()) moveInactiveState(entity, old_iter.value(), iter.isValid() ? &iter.value() : nullptr);
+		else if (iter.isValid()) deactivateScript(entity, script, iter.value());
+	}
+
+	// moves saved state of `entity` from an inactive partition to another one, or to m_saved_globals_ranges
+	// if `to` is null, so it's restored once the instance starts
+	void moveInactiveState(EntityRef entity, OutputMemoryStream& from, OutputMemoryStream* to) {
+		OutputMemoryStream remaining(m_allocator);
+		remaining.reserve(from.size());
+		InputMemoryStream blob(from);
+		while (blob.getPosition() < from.size()) {
+			EntityRef e;
+			blob.read(e);
+			const u32 state_size = blob.read<u32>();
+			const void* state = blob.skip(state_size);
+			OutputMemoryStream* dst = e == entity ? to : &remaining;
+			if (dst) {
+				dst->write(e);
+				dst->write(state_size);
+				dst->write(state, state_size);
+			}
+			else addSavedGlobals(e, state, state_size);
+		}
+		from = static_cast<OutputMemoryStream&&>(remaining);
+	}
+
+	u32 getScriptPartition(EntityRef entity) override { return m_scripts[entity].m_partition; }
+
+	bool isPartitionActive(u32 partition) const override { return !m_inactive_partitions.find(partition).isValid(); }
+
+	// saves state of `script` to `partition_blob`, if it has any, and tears the instance down
+	void deactivateScript(EntityRef entity, Script& script, OutputMemoryStream& partition_blob) {
+		auto saved_globals = m_saved_globals_ranges.find(entity);
+		if (script.m_load_stage == Script::LoadStage::READY) {
+			partition_blob.write(entity);
+			const u64 size_offset = partition_blob.size();
+			partition_blob.write(u32(0));
+			saveGlobals(script, partition_blob);
+			const u32 size = u32(partition_blob.size() - size_offset - sizeof(u32));
+			memcpy(partition_blob.getMutableData() + size_offset, &size, sizeof(size));
+		}
+		else if (saved_globals.isValid()) {
+			// not started yet, e.g. state from deserialize is moved to the partition
+			const SavedGlobals range = saved_globals.value();
+			partition_blob.write(entity);
+			partition_blob.write(range.size);
+			partition_blob.write(m_saved_globals.data() + range.offset, range.size);
+		}
+		if (saved_globals.isValid()) eraseSavedGlobals(entity);
+
+		m_mouse_move_scripts.eraseItem(entity);
+		m_key_input_scripts.eraseItem(entity);
+		freeRuntime(script);
+		script.m_init_failed = false;
+	}
+
+	void deactivatePartition(u32 partition) override {
+		PROFILE_FUNCTION();
+		if (!isPartitionActive(partition)) return;
+
+		m_inactive_partitions.insert(partition, OutputMemoryStream(m_allocator));
+		OutputMemoryStream& partition_blob = m_inactive_partitions[partition];
+		for (auto iter = m_scripts.begin(), end = m_scripts.end(); iter != end; ++iter) {
+			if (iter.value().m_partition != partition) continue;
+			deactivateScript(iter.key(), iter.value(), partition_blob);
+		}
+	}
+
+	void activatePartition(u32 partition) override {
+		PROFILE_FUNCTION();
+		auto partition_iter = m_inactive_partitions.find(partition);
+		if (!partition_iter.isValid()) return;
+
+		// instances are created by instantiateScripts and restore the state in startInstance
+		const OutputMemoryStream& partition_blob = partition_iter.value();
+		InputMemoryStream blob(partition_blob);
+		while (blob.getPosition() < partition_blob.size()) {
+			EntityRef e;
+			blob.read(e);
+			const u32 state_size = blob.read<u32>();
+			const void* state = blob.skip(state_size);
+			// the entity could have been destroyed or moved to another partition meanwhile
+			auto script_iter = m_scripts.find(e);
+			if (!script_iter.isValid() || script_iter.value().m_partition != partition) continue;
+			addSavedGlobals(e, state, state_size);
+		}
+		m_inactive_partitions.erase(partition_iter);
+	}
+
+	ISystem& getSystem() const override { return m_system; }
+	World& getWorld() override { return m_world; }
+
+	void freeRuntime(Script& script) {
+		// until it's loaded, the module is not owned by the runtime
+		if (script.m_load_stage == Script::LoadStage::PARSE && script.m_module) m3_FreeModule(script.m_module);
+		if (script.m_runtime) m3_FreeRuntime(script.m_runtime);
+		script.m_runtime = nullptr;
+		script.m_module = nullptr;
+		script.m_update_fn = nullptr;
+		script.m_mouse_move_fn = nullptr;
+		script.m_key_event_fn = nullptr;
+		script.m_start_fn = nullptr;
+		script.m_self_global = nullptr;
+		script.m_load_stage = Script::LoadStage::NONE;
+		script.m_load_function = 0;
+	}
+
+	void stopGame() override {
+		m_is_game_running = false;
+		m_mouse_move_scripts.clear();
+		m_key_input_scripts.clear();
+		for (ScriptGroup& group : m_groups) {
+			group.scripts.clear();
+			group.entities.clear();
+		}
+		for (Script& script : m_scripts) {
+			freeRuntime(script);
+			script.m_init_failed = false;
+		}
+		// partitions are (de)activated by the game, so they are all active again
+		m_inactive_partitions.clear();
+		clearPools();
+		clearReloads();
+		clearParsedScripts();
+		flushWASIOutput(m_wasi_output);
+		m3_FreeEnvironment(m_environment);
+		m_environment = nullptr;
+		if (m_input_recording_path[0] && m_recorded_frames > 0) saveInputRecording();
+		if (m_trace_path[0] && !m_trace_json.empty()) saveTrace();
+		if (m_frame_stats_path[0]) saveFrameStats(m_frame_stats_path, m_frame_stats_format);
+		if (m_profile_path[0]) {
+			stopProfilerTimer();
+			collectProfilerSamples();
+			if (!m_profile.empty()) saveProfile();
+		}
+	}
+
+	void startGame() override {
+		m_is_game_running = true;
+		m_environment = m3_NewEnvironment();
+		m_input_recording.clear();
+		m_recorded_frames = 0;
+		rewindReplay();
+		m_trace_json.clear();
+		m_trace_start = os::Timer::getRawTimestamp();
+		m_wasi_clock_start = m_trace_start;
+		if (m_profile_path[0]) {
+			m_profile.clear();
+			g_profiler_sample_count = 0;
+			startProfilerTimer(PROFILER_INTERVAL_US);
+		}
+	}
+
+	bool skipsEvents(const Script& script) {
+		if (m_degradation < DEGRADATION_SKIP_LOW_PRIORITY_EVENTS) return false;
+		if (script.m_resource->m_priority != ScriptResource::Priority::LOW) return false;
+		++m_degradation_stats.skipped_events;
+		return true;
+	}
+
+	void onKeyEvent(u32 key_id) {
+		for (EntityRef e : m_key_input_scripts) {
+			Script& script = m_scripts[e];
+			if (skipsEvents(script)) continue;
+			PROFILE_BLOCK("onKeyEvent");
+			++m_frame_stats.events_dispatched;
+			TraceScope trace_scope("onKeyEvent", e, script.m_resource);
+			ProfiledCall profiled_call(script);
+			m3_CallV(script.m_key_event_fn, key_id);
+		}
+	}
+
+	void onMouseMove(float x, float y) {
+		for (EntityRef e : m_mouse_move_scripts) {
+			Script& script = m_scripts[e];
+			if (skipsEvents(script)) continue;
+			PROFILE_BLOCK("onMouseMove");
+			++m_frame_stats.events_dispatched;
+			TraceScope trace_scope("onMouseMove", e, script.m_resource);
+			ProfiledCall profiled_call(script);
+			m3_CallV(script.m_mouse_move_fn, x, y);
+		}
+	}
+
+	static const reflection::Property<float>* getFloatProperty(StableHash property_hash) {
+		const reflection::PropertyBase* prop = reflection::getPropertyFromHash(property_hash);
+		if (!prop) {
+			logError("Property (hash = ", property_hash.getHashValue(), ") not found");
+			return nullptr;
+		}
+		// the hash comes from the script, so it can be any property
+		struct : reflection::IEmptyPropertyVisitor {
+			void visit(const reflection::Property<float>& prop) override { float_prop = &prop; }
+			const reflection::Property<float>* float_prop = nullptr;
+		} visitor;
+		prop->visit(visitor);
+		if (!visitor.float_prop) logError("Property ", prop->name, " is not a float");
+		return visitor.float_prop;
+	}
+
+	float getPropertyFloat(EntityRef entity, StableHash property_hash) {
+		if (t_current_script) {
+			const u32 from = t_current_script->m_snapshot_offset;
+			const u32 to = from + t_current_script->m_snapshot_count;
+			for (u32 i = from; i < to; ++i) {
+				const PropertySnapshot& snapshot = m_snapshot[i];
+				if (snapshot.entity == entity && snapshot.property == property_hash) return snapshot.value;
+			}
+			// not in the snapshot, reading the world is still safe, since nobody writes to it during the update phase
+		}
+
+		const reflection::Property<float>* prop = getFloatProperty(property_hash);
+		if (!prop) return 0;
+		if (!m_world.hasComponent(entity, prop->cmp->component_type)) return 0;
+
+		ComponentUID cmp;
+		cmp.entity = entity;
+		cmp.module = m_world.getModule(prop->cmp->component_type);
+		return prop->get(cmp, -1);
+	}
+
+	void setPropertyFloat(EntityRef entity, StableHash property_hash, float value) {
+		if (t_current_group) {
+			t_current_group->writes.push({DeferredWrite::Type::SET_PROPERTY_FLOAT, entity, property_hash, value});
+			return;
+		}
+
+		const reflection::Property<float>* prop = getFloatProperty(property_hash);
+		if (!prop) return;
+		if (!m_world.hasComponent(entity, prop->cmp->component_type)) return;
+
+		ComponentUID cmp;
+		cmp.entity = entity;
+		cmp.module = m_world.getModule(prop->cmp->component_type);
+		prop->set(cmp, -1, value);
+	}
+
+	void setYaw(EntityRef entity, float yaw) {
+		if (t_current_group) {
+			t_current_group->writes.push({DeferredWrite::Type::SET_YAW, entity, StableHash(), yaw});
+			return;
+		}
+
+		Quat rot(Vec3(0, 1, 0), yaw);
+		m_world.setRotation(entity, rot);
+	}
+
+	static m3ApiRawFunction(API_getPropertyFloat) {
+		m3ApiReturnType(float);
+		ScriptModuleImpl* module = (ScriptModuleImpl*)m3_GetUserData(runtime);
+		m3ApiGetArg(EntityRef, entity);
+		m3ApiGetArg(StableHash, property_hash);
+		TraceScope trace_scope("getPropertyFloat", entity);
+		if (t_host_calls) ++t_host_calls[ScriptFrameStats::GET_PROPERTY_FLOAT];
+		const float value = module->getPropertyFloat(entity, property_hash);
+		m3ApiReturn(value);
+	}
+
+	static m3ApiRawFunction(API_setPropertyFloat) {
+		ScriptModuleImpl* module = (ScriptModuleImpl*)m3_GetUserData(runtime);
+		m3ApiGetArg(EntityRef, entity);
+		m3ApiGetArg(StableHash, property_hash);
+		m3ApiGetArg(float, value);
+		TraceScope trace_scope("setPropertyFloat", entity);
+		if (t_host_calls) ++t_host_calls[ScriptFrameStats::SET_PROPERTY_FLOAT];
+		module->setPropertyFloat(entity, property_hash, value);
+		return m3Err_none;
+	}
+
+	static m3ApiRawFunction(API_setYaw) {
+		ScriptModuleImpl* module = (ScriptModuleImpl*)m3_GetUserData(runtime);
+		m3ApiGetArg(EntityRef, entity);
+		m3ApiGetArg(float, yaw);
+		TraceScope trace_scope("setYaw", entity);
+		if (t_host_calls) ++t_host_calls[ScriptFrameStats::SET_YAW];
+		module->setYaw(entity, yaw);
+		return m3Err_none;
+	}
+
+	// stdout and stderr are buffered and flushed to the log once per frame, see flushWASIOutput
+	static m3ApiRawFunction(WASI_fdWrite) {
+		m3ApiReturnType(u32);
+		m3ApiGetArg(u32, fd);
+		m3ApiGetArgMem(const u32*, iovs);
+		m3ApiGetArg(u32, iovs_len);
+		m3ApiGetArgMem(u32*, nwritten);
+		m3ApiCheckMem(iovs, u64(iovs_len) * 2 * sizeof(u32));
+		m3ApiCheckMem(nwritten, sizeof(u32));
+		if (fd != 1 && fd != 2) m3ApiReturn(WASI_ERRNO_BADF);
+
+		ScriptModuleImpl* module = (ScriptModuleImpl*)m3_GetUserData(runtime);
+		OutputMemoryStream& output = t_wasi_output ? *t_wasi_output : module->m_wasi_output;
+		u32 written = 0;
+		for (u32 i = 0; i < iovs_len; ++i) {
+			const u8* buf = (const u8*)m3ApiOffsetToPtr(m3ApiReadMem32(&iovs[i * 2]));
+			const u32 len = m3ApiReadMem32(&iovs[i * 2 + 1]);
+			m3ApiCheckMem(buf, len);
+			const u64 space = WASI_OUTPUT_LIMIT - minimum(output.size(), (u64)WASI_OUTPUT_LIMIT);
+			output.write(buf, minimum((u64)len, space));
+			written += len;
+		}
+		m3ApiWriteMem32(nwritten, written);
+		m3ApiReturn(WASI_ERRNO_SUCCESS);
+	}
+
+	// all clocks are monotonic, in nanoseconds since the game started
+	static m3ApiRawFunction(WASI_clockTimeGet) {
+		m3ApiReturnType(u32);
+		m3ApiGetArg(u32, clock_id);
+		m3ApiGetArg(u64, precision);
+		m3ApiGetArgMem(u64*, time);
+		m3ApiCheckMem(time, sizeof(u64));
+		(void)precision;
+		// realtime, monotonic, process and thread cputime
+		if (clock_id > 3) m3ApiReturn(WASI_ERRNO_INVAL);
+
+		ScriptModuleImpl* module = (ScriptModuleImpl*)m3_GetUserData(runtime);
+		const u64 ticks = os::Timer::getRawTimestamp() - module->m_wasi_clock_start;
+		const u64 frequency = os::Timer::getFrequency();
+		const u64 ns = ticks / frequency * 1'000'000'000 + ticks % frequency * 1'000'000'000 / frequency;
+		m3ApiWriteMem64(time, ns);
+		m3ApiReturn(WASI_ERRNO_SUCCESS);
+	}
+
+	// xorshift64*, fast but not cryptographically secure
+	static m3ApiRawFunction(WASI_randomGet) {
+		m3ApiReturnType(u32);
+		m3ApiGetArgMem(u8*, buf);
+		m3ApiGetArg(u32, buf_len);
+		m3ApiCheckMem(buf, buf_len);
+
+		u64 state = t_wasi_random ? t_wasi_random : os::Timer::getRawTimestamp() | 1;
+		for (u32 i = 0; i < buf_len; i += sizeof(u64)) {
+			state ^= state >> 12;
+			state ^= state << 25;
+			state ^= state >> 27;
+			const u64 value = state * 0x2545F4914F6CDD1DULL;
+			memcpy(buf + i, &value, minimum(buf_len - i, (u32)sizeof(value)));
+		}
+		t_wasi_random = state;
+		m3ApiReturn(WASI_ERRNO_SUCCESS);
+	}
+
+	// traps, so the instance stops like on any other error, the game goes on
+	static m3ApiRawFunction(WASI_procExit) {
+		m3ApiTrap(m3Err_trapExit);
+	}
+
+	// links functions in WASI_NAMES; scripts compiled from graphs do not import WASI, so it's looked up by name
+	static bool linkWASI(IM3Module module, M3Result& res) {
+		// in WASI_NAMES order
+		static const M3RawCall wasi_api[] = { &ScriptModuleImpl::WASI_fdWrite, &ScriptModuleImpl::WASI_clockTimeGet, &ScriptModuleImpl::WASI_randomGet, &ScriptModuleImpl::WASI_procExit };
+		static_assert(lengthOf(wasi_api) == lengthOf(WASI_NAMES));
+
+		for (u32 i = 0; i < lengthOf(wasi_api); ++i) {
+			res = m3_LinkRawFunction(module, WASI_MODULE, WASI_NAMES[i], WASI_SIGNATURES[i], wasi_api[i]);
+			if (res != m3Err_none && res != m3Err_functionLookupFailed) return false;
+		}
+		return true;
+	}
+
+	static void flushWASIOutput(OutputMemoryStream& output) {
+		if (output.empty()) return;
+		const bool truncated = output.size() >= WASI_OUTPUT_LIMIT;
+		if (((const char*)output.data())[output.size() - 1] == '\n') output.getMutableData()[output.size() - 1] = '\0';
+		else output.write('\0');
+		logInfo((const char*)output.data(), truncated ? "\n(script output truncated)" : "");
+		output.clear();
+	}
+
+	void processEvents() {
+		if (!m_input_replay.empty()) {
+			replayEvents();
+			return;
+		}
+
+		const bool recording = m_input_recording_path[0];
+		const u64 count_offset = m_input_recording.size();
+		u16 count = 0;
+		if (recording) m_input_recording.write(count);
+
+		InputSystem& input = m_engine.getInputSystem();
+		Span<const InputSystem::Event> events = input.getEvents();
+		for (const InputSystem::Event& e : events) {
+			switch(e.type) {
+				case InputSystem::Event::BUTTON:
+					if (e.device->type == InputSystem::Device::KEYBOARD) {
+						if (recording) {
+							m_input_recording.write(RecordedEventType::KEY);
+							m_input_recording.write(e.data.button.key_id);
+							++count;
+						}
+						onKeyEvent(e.data.button.key_id);
+					}
+					break;
+				case InputSystem::Event::AXIS:
+					if (e.device->type == InputSystem::Device::MOUSE) {
+						if (recording) {
+							m_input_recording.write(RecordedEventType::MOUSE_MOVE);
+							m_input_recording.write(e.data.axis.x);
+							m_input_recording.write(e.data.axis.y);
+							++count;
+						}
+						onMouseMove(e.data.axis.x, e.data.axis.y);
+					}
+					break;
+				default: break;
+			}
+		}
+
+		if (recording) {
+			memcpy(m_input_recording.getMutableData() + count_offset, &count, sizeof(count));
+			++m_recorded_frames;
+		}
+	}
+
+	// dispatches the next recorded frame instead of the input system's events
+	void replayEvents() {
+		if (m_replayed_frames >= m_replay_frames) return;
+
+		InputMemoryStream blob(m_input_replay);
+		blob.setPosition(m_replay_offset);
+		const u16 count = blob.read<u16>();
+		for (u16 i = 0; i < count; ++i) {
+			switch (blob.read<RecordedEventType>()) {
+				case RecordedEventType::KEY: onKeyEvent(blob.read<u32>()); break;
+				case RecordedEventType::MOUSE_MOVE: {
+					const float x = blob.read<float>();
+					const float y = blob.read<float>();
+					onMouseMove(x, y);
+					break;
+				}
+				default:
+					logError("Corrupted input recording");
+					m_replayed_frames = m_replay_frames;
+					return;
+			}
+		}
+		m_replay_offset = blob.getPosition();
+		++m_replayed_frames;
+	}
+
+	// returns false if the function exists but can not be compiled
+	static bool findFunction(IM3Runtime runtime, const char* name, IM3Function& fn, M3Result& res) {
+		res = m3_FindFunction(&fn, runtime, name);
+		if (res == m3Err_none) return true;
+		fn = nullptr;
+		return res == m3Err_functionLookupFailed;
+	}
+
+	// one step of everything that does not depend on the entity - parse, load, link and compile; steps are small
+	// (a section or a function), so large modules can be instantiated over several frames, see setInstantiationBudget
+	bool createInstanceStep(Script& script) {
+		TimeScope compile_time(m_frame_stats.compile_ms);
+		auto onError = [&](const char* msg){
+			logError(script.m_resource->getPath(), ": ", msg);
+			script.m_init_failed = true;
+			freeRuntime(script);
+			return false;
+		};
+
+		// the runtime takes ownership of the parsed module
+		auto load = [&](){
+			const M3Result load_res = m3_LoadModule(script.m_runtime, script.m_module);
+			if (load_res != m3Err_none) {
+				m3_FreeModule(script.m_module);
+				script.m_module = nullptr;
+				return onError(load_res);
+			}
+			// trusted path - the asset compiler already evaluated global initializers when it validated the
+			// script, so only the first instance does, the rest get the values with the parsed module
+			if (script.m_resource->m_validated) {
+				auto parsed = m_parsed_scripts.find(script.m_resource);
+				if (parsed.isValid() && parsed.value().generation == script.m_generation && !parsed.value().globals_baked) {
+					m3l_bakeGlobals(parsed.value().module, script.m_module);
+					parsed.value().globals_baked = true;
+				}
+			}
+			script.m_load_stage = Script::LoadStage::COMPILE;
+			script.m_load_function = 0;
+			M3Result link_res;
+			if (!linkInstance(script, link_res)) return onError(link_res);
+			return true;
+		};
+
+		switch (script.m_load_stage) {
+			case Script::LoadStage::NONE: {
+				// also if it fails, so the instance is retried once the resource is reloaded
+				script.m_generation = script.m_resource->m_generation;
+				script.m_runtime = m3_NewRuntime(m_environment, script.m_resource->getStackSize(), this);
+				if (!script.m_runtime) return onError("Failed to create runtime");
+				m3l_setMemoryLimit(script.m_runtime, script.m_resource->m_memory_limit);
+
+				// only the first instance parses the bytecode, the rest copy its module
+				script.m_load_stage = Script::LoadStage::PARSE;
+				if (IM3Module parsed = getParsedScript(*script.m_resource)) {
+					const M3Result clone_res = m3l_cloneModule(parsed, &script.m_module);
+					if (clone_res != m3Err_none) return onError(clone_res);
+					return load();
+				}
+
+				const Span<const u8> bytecode = script.m_resource->m_bytecode;
+				const M3Result parse_res = m3_ParseModuleBegin(m_environment, &script.m_module, bytecode.begin(), bytecode.length());
+				if (parse_res != m3Err_none) return onError(parse_res);
+				return true;
+			}
+			case Script::LoadStage::PARSE: {
+				int done = 0;
+				const M3Result parse_res = m3_ParseModuleSection(&script.m_module, &done);
+				if (parse_res != m3Err_none) return onError(parse_res);
+				if (!done) return true;
+
+				if (!getParsedScript(*script.m_resource)) addParsedScript(script);
+				return load();
+			}
+			case Script::LoadStage::COMPILE: {
+				// compiles the functions, so worker threads never touch the shared environment
+				if (script.m_load_function < m3l_getFunctionCount(script.m_module)) {
+					const M3Result compile_res = m3l_compileFunction(script.m_module, script.m_load_function);
+					if (compile_res != m3Err_none) return onError(compile_res);
+					++script.m_load_function;
+					return true;
+				}
+				M3Result find_res;
+				if (!findEntryPoints(script, find_res)) return onError(find_res);
+				script.m_load_stage = Script::LoadStage::READY;
+				return true;
+			}
+			case Script::LoadStage::READY: return true;
+		}
+		ASSERT(false);
+		return false;
+	}
+
+	// parsed module of the current bytecode of `res`, null if no instance of it was parsed yet
+	IM3Module getParsedScript(ScriptResource& res) {
+		auto iter = m_parsed_scripts.find(&res);
+		if (!iter.isValid() || iter.value().generation != res.m_generation) return nullptr;
+		return iter.value().module;
+	}
+
+	// keeps a copy of the module of `script`, which is parsed but not loaded yet
+	void addParsedScript(const Script& script) {
+		IM3Module parsed;
+		if (m3l_cloneModule(script.m_module, &parsed) != m3Err_none) return;
+
+		ScriptResource* res = script.m_resource;
+		auto iter = m_parsed_scripts.find(res);
+		if (iter.isValid()) {
+			// parsed from older bytecode
+			m3_FreeModule(iter.value().module);
+			iter.value() = { parsed, script.m_generation, false };
+			return;
+		}
+		// so the bytecode the module references is not freed, except by a reload, which makes it stale
+		res->incRefCount();
+		m_parsed_scripts.insert(res, { parsed, script.m_generation, false });
+	}
+
+	// must be called before m_environment is freed
+	void clearParsedScripts() {
+		for (auto iter = m_parsed_scripts.begin(), end = m_parsed_scripts.end(); iter != end; ++iter) {
+			m3_FreeModule(iter.value().module);
+			iter.key()->decRefCount();
+		}
+		m_parsed_scripts.clear();
+	}
+
+	// links host functions and finds `self`
+	static bool linkInstance(Script& script, M3Result& res) {
+		// in ScriptFrameStats::HostAPI order
+		static const M3RawCall host_api[] = { &ScriptModuleImpl::API_setYaw, &ScriptModuleImpl::API_setPropertyFloat, &ScriptModuleImpl::API_getPropertyFloat };
+		static_assert(lengthOf(host_api) == ScriptFrameStats::HOST_API_COUNT);
+
+		const ScriptResource::Metadata& metadata = script.m_resource->m_metadata;
+		if (metadata.valid) {
+			// everything is precomputed by the compiler, nothing is looked up by name
+			for (const ScriptResource::Metadata::Import& import : metadata.imports) {
+				if (import.api == ScriptResource::Metadata::NONE) continue;
+				res = m3l_linkFunction(script.m_module, import.function, host_api[import.api]);
+				if (res != m3Err_none) return false;
+			}
+
+			script.m_self_global = m3l_getGlobal(script.m_module, metadata.self_global);
+		}
+		else {
+			for (u32 i = 0; i < lengthOf(host_api); ++i) {
+				res = m3_LinkRawFunction(script.m_module, "LumixAPI", HOST_API_NAMES[i], nullptr, host_api[i]);
+				if (res != m3Err_none && res != m3Err_functionLookupFailed) return false;
+			}
+			if (!linkWASI(script.m_module, res)) return false;
+
+			script.m_self_global = m3_FindGlobal(script.m_module, "self");
+		}
+		res = script.m_self_global ? m3Err_none : "`self` not found";
+		return script.m_self_global;
+	}
+
+	// entry points are set only once all functions are compiled, until then the instance is not updated
+	static bool findEntryPoints(Script& script, M3Result& res) {
+		// in Metadata::EntryPoint order
+		IM3Function* entry_points[] = { &script.m_update_fn, &script.m_mouse_move_fn, &script.m_key_event_fn, &script.m_start_fn };
+		static_assert(lengthOf(entry_points) == (u32)ScriptResource::Metadata::EntryPoint::COUNT);
+
+		const ScriptResource::Metadata& metadata = script.m_resource->m_metadata;
+		for (u32 i = 0; i < lengthOf(entry_points); ++i) {
+			*entry_points[i] = nullptr;
+			if (metadata.valid) {
+				if (metadata.entry_points[i] == ScriptResource::Metadata::NONE) continue;
+				res = m3l_getFunction(script.m_module, metadata.entry_points[i], entry_points[i]);
+				if (res != m3Err_none) return false;
+			}
+			else if (!findFunction(script.m_runtime, ScriptResource::Metadata::ENTRY_POINT_NAMES[i], *entry_points[i], res)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// all steps at once
+	bool createInstance(Script& script) {
+		while (script.m_load_stage != Script::LoadStage::READY) {
+			if (!createInstanceStep(script)) return false;
+		}
+		return true;
+	}
+
+	// binds an instance created by createInstance to `entity` and runs its `start`
+	bool startInstance(Script& script, EntityRef entity) {
+		M3TaggedValue self_value;
+		self_value.type = c_m3Type_i32;
+		self_value.value.i32 = entity.index;
+		const M3Result set_self_res = m3_SetGlobal(script.m_self_global, &self_value);
+		if (set_self_res != m3Err_none) {
+			logError(script.m_resource->getPath(), ": ", set_self_res);
+			script.m_init_failed = true;
+			freeRuntime(script);
+			return false;
+		}
+
+		auto saved_globals = m_saved_globals_ranges.find(entity);
+		if (saved_globals.isValid()) {
+			const SavedGlobals range = saved_globals.value();
+			InputMemoryStream state(m_saved_globals.data() + range.offset, range.size);
+			restoreGlobals(script, state);
+			eraseSavedGlobals(entity);
+		}
+
+		if (script.m_mouse_move_fn) m_mouse_move_scripts.push(entity);
+		if (script.m_key_event_fn) m_key_input_scripts.push(entity);
+		if (script.m_start_fn) {
+			TraceScope trace_scope("start", entity, script.m_resource);
+			ProfiledCall profiled_call(script);
+			m3_CallV(script.m_start_fn);
+		}
+		return true;
+	}
+
+	bool instantiate(Script& script, EntityRef entity) {
+		if (!createInstance(script)) return false;
+		++m_frame_stats.instantiations;
+		return startInstance(script, entity);
+	}
+
+	ScriptPool* getPool(const Path& path) {
+		for (ScriptPool& pool : m_pools) {
+			if (pool.resource->getPath() == path) return &pool;
+		}
+		return nullptr;
+	}
+
+	ScriptResource* getConfiguredResource(const Path& path) {
+		for (ScriptResource* res : m_configured_resources) {
+			if (res->getPath() == path) return res;
+		}
+		ScriptResource* res = m_engine.getResourceManager().load<ScriptResource>(path);
+		m_configured_resources.push(res);
+		return res;
+	}
+
+	void setScriptMemoryLimit(const Path& path, u32 limit) override {
+		getConfiguredResource(path)->m_memory_limit = limit;
+	}
+
+	void setScriptPriority(const Path& path, ScriptResource::Priority priority) override {
+		getConfiguredResource(path)->m_priority = priority;
+	}
+
+	void reservePool(const Path& path, u32 count) override {
+		ScriptPool* pool = getPool(path);
+		if (!pool) {
+			pool = &m_pools.emplace(m_allocator);
+			pool->resource = m_engine.getResourceManager().load<ScriptResource>(path);
+		}
+		if (count > pool->size) pool->needs_fill = true;
+		pool->size = maximum(pool->size, count);
+	}
+
+	// instances need the environment and a ready resource, so pools are filled in the first update after both exist;
+	// instances taken by spawnScript are replaced only within the instantiation budget, one per pool and frame,
+	// otherwise each spawn would pay a full instantiation in the next update
+	void fillPools(os::Timer& timer) {
+		for (ScriptPool& pool : m_pools) {
+			if (!pool.resource->isReady()) continue;
+			if (pool.instances.size() >= pool.size) continue;
+
+			if (pool.needs_fill) {
+				PROFILE_BLOCK("fill script pool");
+				pool.needs_fill = false;
+				pool.instances.reserve(pool.size);
+				while (pool.instances.size() < pool.size) {
+					Script& script = pool.instances.emplace();
+					script.m_resource = pool.resource;
+					pool.resource->incRefCount();
+					if (!createInstance(script)) {
+						pool.instances.pop();
+						// it would fail for the rest of the instances too
+						pool.size = pool.instances.size();
+						break;
+					}
+				}
+				continue;
+			}
+
+			if (m_instantiation_budget_ms <= 0) continue;
+			Script& script = pool.refill;
+			if (!script.m_resource) {
+				script.m_resource = pool.resource;
+				pool.resource->incRefCount();
+			}
+			while (script.m_load_stage != Script::LoadStage::READY) {
+				if (timer.getTimeSinceStart() * 1000 > m_instantiation_budget_ms) return;
+				if (!createInstanceStep(script)) break;
+			}
+			if (script.m_load_stage != Script::LoadStage::READY) {
+				pool.size = pool.instances.size();
+				continue;
+			}
+			pool.instances.push(static_cast<Script&&>(script));
+		}
+	}
+
+	static void clearRefill(ScriptPool& pool) {
+		if (!pool.refill.m_resource) return;
+		pool.refill.m_resource->decRefCount();
+		pool.refill.m_resource = nullptr;
+	}
+
+	void clearPools() {
+		for (ScriptPool& pool : m_pools) {
+			for (Script& script : pool.instances) freeRuntime(script);
+			pool.instances.clear();
+			freeRuntime(pool.refill);
+			clearRefill(pool);
+			pool.needs_fill = true;
+		}
+	}
+
+	static void addMemoryStats(const Script& script, ScriptMemoryStats& stats) {
+		if (!script.m_runtime) return;
+
+		M3LMemoryStats runtime_stats;
+		m3l_getMemoryStats(script.m_runtime, &runtime_stats);
+		++stats.instances;
+		stats.stack += runtime_stats.stack;
+		stats.code += runtime_stats.code;
+		stats.globals += runtime_stats.globals;
+		stats.linear_memory += runtime_stats.linear_memory;
+	}
+
+	ScriptMemoryStats getInstanceMemoryStats(EntityRef entity) override {
+		ScriptMemoryStats stats;
+		addMemoryStats(m_scripts[entity], stats);
+		return stats;
+	}
+
+	ScriptMemoryStats getResourceMemoryStats(const Path& path) override {
+		ScriptMemoryStats stats;
+		for (const Script& script : m_scripts) {
+			if (script.m_resource && script.m_resource->getPath() == path) addMemoryStats(script, stats);
+		}
+		if (ScriptPool* pool = getPool(path)) {
+			for (const Script& script : pool->instances) addMemoryStats(script, stats);
+		}
+		return stats;
+	}
+
+	bool spawnScript(EntityRef entity, const Path& path) override {
+		ScriptPool* pool = getPool(path);
+		if (!pool || pool->instances.empty()) {
+			createScript(entity);
+			setScriptResource(entity, path);
+			return false;
+		}
 
-	script.m_resource = nullptr;
-	script.m_runtime = nullptr;
-	script.m_module = nullptr;
-}
+		m_scripts.insert(entity, static_cast<Script&&>(pool->instances.back()));
+		pool->instances.pop();
+		m_world.onComponentCreated(entity, SCRIPT_TYPE, this);
+		startInstance(m_scripts[entity], entity);
+		return true;
+	}
 
-Script::~Script() {
-	if (m_resource) m_resource->decRefCount();
-	ASSERT(!m_runtime);
-	ASSERT(!m_module);
-}
+	// exchanges wasm instances, the component's data (resource, partition, ...) stays
+	static void swapInstances(Script& a, Script& b) {
+		auto swap = [](auto& x, auto& y) {
+			auto tmp = x;
+			x = y;
+			y = tmp;
+		};
+		swap(a.m_runtime, b.m_runtime);
+		swap(a.m_module, b.m_module);
+		swap(a.m_update_fn, b.m_update_fn);
+		swap(a.m_mouse_move_fn, b.m_mouse_move_fn);
+		swap(a.m_key_event_fn, b.m_key_event_fn);
+		swap(a.m_start_fn, b.m_start_fn);
+		swap(a.m_self_global, b.m_self_global);
+		swap(a.m_load_stage, b.m_load_stage);
+		swap(a.m_load_function, b.m_load_function);
+		swap(a.m_generation, b.m_generation);
+	}
 
-struct ScriptModuleImpl : ScriptModule {
-	ScriptModuleImpl(ISystem& system, Engine& engine, World& world, IAllocator& allocator)
-		: m_system(system)
-		, m_world(world)
-		, m_engine(engine)
-		, m_allocator(allocator)
-		, m_scripts(allocator)
-		, m_mouse_move_scripts(allocator)
-		, m_key_input_scripts(allocator)
-	{}
+	// instances of resources reloaded while the game runs get replacements created from the new code, see reloadScripts;
+	// instances which failed are retried with the new code
+	void hotReloadScripts() {
+		ScriptManager& manager = static_cast<ScriptManager&>(*m_engine.getResourceManager().get(ScriptResource::TYPE));
+		if (manager.getDataGeneration() == m_data_generation) return;
+		m_data_generation = manager.getDataGeneration();
 
-	const char* getName() const override { return "script"; }
+		PROFILE_FUNCTION();
+		for (auto iter = m_scripts.begin(), end = m_scripts.end(); iter != end; ++iter) {
+			Script& script = iter.value();
+			ScriptResource* res = script.m_resource;
+			if (script.m_load_stage == Script::LoadStage::NONE) {
+				if (script.m_init_failed && res && script.m_generation != res->m_generation) script.m_init_failed = false;
+				continue;
+			}
+			if (script.m_load_stage != Script::LoadStage::READY) {
+				// partially loaded instances still need the bytecode, start over if it's gone
+				if (!res->isReady() || script.m_generation != res->m_generation) freeRuntime(script);
+				continue;
+			}
+			if (!res->isReady() || script.m_generation == res->m_generation) continue;
+			if (m_reloads.find(iter.key()).isValid()) continue;
 
-	void tryCall(EntityRef entity, const char* function_name, ...) {
-		Script& scr = m_scripts[entity];
-		va_list ap;
-		va_start(ap, function_name);
-		IM3Function fn;
-		M3Result find_res = m3_FindFunction(&fn, scr.m_runtime, function_name);
-		if (find_res == m3Err_none) {
-			PROFILE_BLOCK("tryCall");
-			m3_CallVL(fn, ap);
+			Script reloaded;
+			reloaded.m_resource = res;
+			res->incRefCount();
+			m_reloads.insert(iter.key(), static_cast<Script&&>(reloaded));
 		}
-		else if (find_res != m3Err_functionLookupFailed) {
-			logError(scr.m_resource->getPath(), ": ", find_res);
+
+		// pooled instances have not started yet, so they are simply created again
+		for (ScriptPool& pool : m_pools) {
+			if (!pool.resource->isReady()) continue;
+			const u32 generation = pool.resource->m_generation;
+			const bool stale_instances = !pool.instances.empty() && pool.instances[0].m_generation != generation;
+			const bool stale_refill = pool.refill.m_load_stage != Script::LoadStage::NONE && pool.refill.m_generation != generation;
+			if (!stale_instances && !stale_refill) continue;
+			for (Script& script : pool.instances) freeRuntime(script);
+			pool.instances.clear();
+			freeRuntime(pool.refill);
+			pool.needs_fill = true;
 		}
-		va_end(ap);
 	}
 
-	void serialize(OutputMemoryStream& blob) override {
-		blob.write(m_scripts.size());
-		for (auto iter = m_scripts.begin(), end = m_scripts.end(); iter != end; ++iter) {
-			blob.write(iter.key());
-			ScriptResource* res = iter.value().m_resource;
-			blob.writeString(res ? res->getPath().c_str() : "");
+	// replacements are created one at a time, within the instantiation budget if there's one, and swapped in when ready;
+	// globals are migrated by name and type and `start` is not called again; the first replacement of a resource compiles
+	// the new code, if a replacement fails, the rest would fail the same way, so they are dropped and old instances keep running
+	void reloadScripts(os::Timer& timer) {
+		if (m_reloads.empty()) return;
+
+		PROFILE_FUNCTION();
+		const bool budgeted = m_instantiation_budget_ms > 0;
+		while (!m_reloads.empty()) {
+			auto iter = m_reloads.begin();
+			const EntityRef entity = iter.key();
+			Script& reloaded = iter.value();
+			ScriptResource* res = reloaded.m_resource;
+			auto script_iter = m_scripts.find(entity);
+			// destroyed, deactivated or changed resource meanwhile; not ready resources queue new reloads once loaded
+			if (!script_iter.isValid()
+				|| script_iter.value().m_resource != res
+				|| script_iter.value().m_load_stage != Script::LoadStage::READY
+				|| !res->isReady())
+			{
+				freeRuntime(reloaded);
+				m_reloads.erase(entity);
+				continue;
+			}
+			// reloaded again while the replacement was being created
+			if (reloaded.m_load_stage != Script::LoadStage::NONE && reloaded.m_generation != res->m_generation) {
+				freeRuntime(reloaded);
+			}
+
+			while (reloaded.m_load_stage != Script::LoadStage::READY) {
+				if (budgeted && timer.getTimeSinceStart() * 1000 > m_instantiation_budget_ms) return;
+				if (!createInstanceStep(reloaded)) break;
+			}
+			if (reloaded.m_load_stage != Script::LoadStage::READY) {
+				logError(res->getPath(), ": reload failed, the old version keeps running");
+				dropReloads(*res);
+				continue;
+			}
+
+			Script& script = script_iter.value();
+			m_reload_state.clear();
+			saveGlobals(script, m_reload_state);
+			InputMemoryStream state_blob(m_reload_state);
+			restoreGlobals(reloaded, state_blob);
+			M3TaggedValue self_value;
+			m3_GetGlobal(script.m_self_global, &self_value);
+			m3_SetGlobal(reloaded.m_self_global, &self_value);
+
+			if (script.m_mouse_move_fn) m_mouse_move_scripts.eraseItem(entity);
+			if (script.m_key_event_fn) m_key_input_scripts.eraseItem(entity);
+			swapInstances(script, reloaded);
+			freeRuntime(reloaded);
+			m_reloads.erase(entity);
+			// e.g. the old code trapped in update
+			script.m_init_failed = false;
+			if (script.m_mouse_move_fn) m_mouse_move_scripts.push(entity);
+			if (script.m_key_event_fn) m_key_input_scripts.push(entity);
 		}
 	}
 
-	void deserialize(InputMemoryStream& blob, const EntityMap& entity_map, i32 version) override {
-		u32 count;
-		blob.read(count);
-		ResourceManagerHub& rm = m_engine.getResourceManager();
-		for (u32 i = 0; i < count; ++i) {
-			EntityRef e;
-			blob.read(e);
-			e = entity_map.get(e);
-			const char* path = blob.readString();
-			Script script;
-			script.m_resource = path[0] ? rm.load<ScriptResource>(Path(path)) : nullptr;
-			m_scripts.insert(e, static_cast<Script&&>(script));
-			m_world.onComponentCreated(e, SCRIPT_TYPE, this);
+	// the rest would fail the same way, so their instances are marked as up to date and keep the old code
+	void dropReloads(ScriptResource& res) {
+		Array<EntityRef> dropped(m_allocator);
+		for (auto iter = m_reloads.begin(), end = m_reloads.end(); iter != end; ++iter) {
+			if (iter.value().m_resource == &res) dropped.push(iter.key());
+		}
+		for (EntityRef entity : dropped) {
+			auto script_iter = m_scripts.find(entity);
+			if (script_iter.isValid()) script_iter.value().m_generation = res.m_generation;
+			freeRuntime(m_reloads[entity]);
+			m_reloads.erase(entity);
 		}
 	}
 
-	ISystem& getSystem() const override { return m_system; }
-	World& getWorld() override { return m_world; }
+	void clearReloads() {
+		for (Script& script : m_reloads) freeRuntime(script);
+		m_reloads.clear();
+	}
 
-	void stopGame() override {
-		m_is_game_running = false;
-		m_mouse_move_scripts.clear();
-		m_key_input_scripts.clear();
+	void instantiateScripts(os::Timer& timer) {
+		PROFILE_FUNCTION();
+		const bool deferred = m_degradation >= DEGRADATION_DEFERRED_INSTANTIATION;
+		const bool budgeted = m_instantiation_budget_ms > 0;
+		u32 count = 0;
+		for (auto iter = m_scripts.begin(), end = m_scripts.end(); iter != end; ++iter) {
+			Script& script = iter.value();
+			if (script.m_load_stage == Script::LoadStage::READY) continue;
+			if (script.m_init_failed) continue;
+			if (!script.m_resource) continue;
+			if (!script.m_resource->isReady()) continue;
+			if (!isPartitionActive(script.m_partition)) continue;
+			if (deferred && count == DEFERRED_INSTANTIATIONS_PER_FRAME) {
+				++m_degradation_stats.deferred_instantiations;
+				continue;
+			}
+
+			if (!budgeted) {
+				instantiate(script, iter.key());
+				++count;
+				continue;
+			}
+
+			while (script.m_load_stage != Script::LoadStage::READY) {
+				if (timer.getTimeSinceStart() * 1000 > m_instantiation_budget_ms) return;
+				if (!createInstanceStep(script)) break;
+			}
+			if (script.m_load_stage != Script::LoadStage::READY) continue;
+			++m_frame_stats.instantiations;
+			startInstance(script, iter.key());
+			++count;
+		}
 	}
 
-	void startGame() override {
-		m_is_game_running = true;
-		m_environment = m3_NewEnvironment();
+	void setInstantiationBudget(float budget_ms) override {
+		m_instantiation_budget_ms = budget_ms;
 	}
 
-	void onKeyEvent(const InputSystem::Event& event) {
-		for (EntityRef e : m_key_input_scripts) {
-			tryCall(e, "onKeyEvent", event.data.button.key_id);
+	// groups instances by resource and assigns each group a level, so that groups on the same level do not conflict
+	// and each group runs after all conflicting groups with lower index, i.e. levels are a topological order of the DAG
+	u32 buildGroups() {
+		PROFILE_FUNCTION();
+		for (ScriptGroup& group : m_groups) {
+			group.scripts.clear();
+			group.entities.clear();
 		}
-	}
 
-	void onMouseMove(const InputSystem::Event& event) {
-		for (EntityRef e : m_mouse_move_scripts) {
-			tryCall(e, "onMouseMove", event.data.axis.x, event.data.axis.y);
+		for (auto iter = m_scripts.begin(), end = m_scripts.end(); iter != end; ++iter) {
+			Script& script = iter.value();
+			if (!script.m_update_fn) continue;
+
+			auto group_iter = m_group_indices.find(script.m_resource);
+			u32 group_idx;
+			if (group_iter.isValid()) {
+				group_idx = group_iter.value();
+			}
+			else {
+				group_idx = m_groups.size();
+				m_groups.emplace(m_allocator);
+				m_group_indices.insert(script.m_resource, group_idx);
+			}
+			ScriptGroup& group = m_groups[group_idx];
+			group.resource = script.m_resource;
+			group.scripts.push(&script);
+			group.entities.push(iter.key());
+		}
+
+		u32 max_level = 0;
+		for (u32 i = 0, c = m_groups.size(); i < c; ++i) {
+			ScriptGroup& group = m_groups[i];
+			if (group.scripts.empty()) continue;
+
+			group.level = 0;
+			// writes are deferred in snapshot mode, so there are no conflicts
+			if (m_snapshot_mode) continue;
+
+			for (u32 j = 0; j < i; ++j) {
+				const ScriptGroup& prev = m_groups[j];
+				if (prev.scripts.empty()) continue;
+				if (group.level > prev.level) continue;
+				if (group.resource->m_access_set.conflicts(prev.resource->m_access_set)) {
+					group.level = prev.level + 1;
+				}
+			}
+			max_level = maximum(max_level, group.level);
 		}
+		return max_level;
 	}
 
-	static m3ApiRawFunction(API_getPropertyFloat) {
-		m3ApiReturnType(float);
-		ScriptModuleImpl* module = (ScriptModuleImpl*)m3_GetUserData(runtime);
-		World& world = module->getWorld();
-		m3ApiGetArg(EntityRef, entity);
-		m3ApiGetArg(StableHash, property_hash);
-		const reflection::PropertyBase* prop = reflection::getPropertyFromHash(property_hash);
-		if (!prop) {
-			logError("Property (hash = ", property_hash.getHashValue(), ") not found");
-			return m3Err_none;
+	// copies properties from the read sets of scripts' own entities, other reads fall back to the world,
+	// which is safe too, since all writes are deferred until the end of the update phase
+	void buildSnapshot() {
+		PROFILE_FUNCTION();
+		m_snapshot.clear();
+		for (auto iter = m_scripts.begin(), end = m_scripts.end(); iter != end; ++iter) {
+			Script& script = iter.value();
+			script.m_snapshot_offset = m_snapshot.size();
+			script.m_snapshot_count = 0;
+			if (!script.m_update_fn) continue;
+
+			const EntityRef entity = iter.key();
+			for (StableHash property_hash : script.m_resource->m_access_set.reads) {
+				const reflection::Property<float>* prop = getFloatProperty(property_hash);
+				if (!prop) continue;
+				if (!m_world.hasComponent(entity, prop->cmp->component_type)) continue;
+
+				ComponentUID cmp;
+				cmp.entity = entity;
+				cmp.module = m_world.getModule(prop->cmp->component_type);
+				m_snapshot.push({entity, property_hash, prop->get(cmp, -1)});
+				++script.m_snapshot_count;
+			}
 		}
-		const reflection::Property<float>* fprop = static_cast<const reflection::Property<float>*>(prop);
-		ComponentUID cmp;
-		cmp.entity = entity;
-		cmp.module = world.getModule(prop->cmp->component_type);
-		ASSERT(cmp.module);
-		const float value = fprop->get(cmp, -1);
-		ASSERT(false); // TODO check if this function is correct
-		m3ApiReturn(value);
 	}
 
-	static m3ApiRawFunction(API_setPropertyFloat) {
-		ScriptModuleImpl* module = (ScriptModuleImpl*)m3_GetUserData(runtime);
-		World& world = module->getWorld();
-		m3ApiGetArg(EntityRef, entity);
-		m3ApiGetArg(StableHash, property_hash);
-		m3ApiGetArg(float, value);
-		const reflection::PropertyBase* prop = reflection::getPropertyFromHash(property_hash);
-		if (!prop) {
-			logError("Property (hash = ", property_hash.getHashValue(), ") not found");
-			return m3Err_none;
+	void applyDeferredWrites() {
+		PROFILE_FUNCTION();
+		// in group order, so the result does not depend on which thread finished first
+		for (ScriptGroup& group : m_groups) {
+			for (const DeferredWrite& write : group.writes) {
+				switch (write.type) {
+					case DeferredWrite::Type::SET_YAW: setYaw(write.entity, write.value); break;
+					case DeferredWrite::Type::SET_PROPERTY_FLOAT: setPropertyFloat(write.entity, write.property, write.value); break;
+				}
+			}
+			group.writes.clear();
 		}
-		const reflection::Property<float>* fprop = static_cast<const reflection::Property<float>*>(prop);
-		ComponentUID cmp;
-		cmp.entity = entity;
-		cmp.module = world.getModule(prop->cmp->component_type);
-		ASSERT(cmp.module);
-		fprop->set(cmp, -1, value);
-		return m3Err_none;
 	}
 
-	static m3ApiRawFunction(API_setYaw) {
-		ScriptModuleImpl* module = (ScriptModuleImpl*)m3_GetUserData(runtime);
-		World& world = module->getWorld();
-		m3ApiGetArg(EntityRef, entity);
-		m3ApiGetArg(float, yaw);
-		Quat rot(Vec3(0, 1, 0), yaw);
-		world.setRotation(entity, rot);
-		return m3Err_none;
+	// low priority scripts are updated only every few frames while degraded
+	bool skipsTick(const ScriptGroup& group) const {
+		if (m_degradation < DEGRADATION_LOW_PRIORITY_TICK_RATE) return false;
+		if (group.resource->m_priority != ScriptResource::Priority::LOW) return false;
+		return m_frame % LOW_PRIORITY_TICK_INTERVAL != 0;
 	}
 
-	void processEvents() {
-		InputSystem& input = m_engine.getInputSystem();
-		Span<const InputSystem::Event> events = input.getEvents();
-		for (const InputSystem::Event& e : events) {
-			switch(e.type) {
-				case InputSystem::Event::BUTTON:
-					if (e.device->type == InputSystem::Device::KEYBOARD) {
-						onKeyEvent(e);
-					}
-					break;
-				case InputSystem::Event::AXIS:
-					if (e.device->type == InputSystem::Device::MOUSE) {
-						onMouseMove(e);
-					}
-					break;
-				default: break;
+	void updateGroup(ScriptGroup& group, float time_delta) {
+		PROFILE_FUNCTION();
+		time_delta += group.skipped_time;
+		group.skipped_time = 0;
+		if (m_snapshot_mode) t_current_group = &group;
+		Array<TraceEvent>* prev_trace = t_trace;
+		if (m_trace_path[0]) t_trace = &group.trace;
+		u32* prev_host_calls = t_host_calls;
+		memset(group.host_calls, 0, sizeof(group.host_calls));
+		t_host_calls = group.host_calls;
+		OutputMemoryStream* prev_wasi_output = t_wasi_output;
+		t_wasi_output = &group.wasi_output;
+		group.updated = 0;
+		for (u32 i = 0, c = group.scripts.size(); i < c; ++i) {
+			Script* script = group.scripts[i];
+			if (script->m_init_failed) continue;
+			++group.updated;
+			if (m_snapshot_mode) t_current_script = script;
+			TraceScope trace_scope("update", group.entities[i], group.resource);
+			ProfiledCall profiled_call(*script);
+			const M3Result res = m3_CallV(script->m_update_fn, time_delta);
+			if (res != m3Err_none) {
+				logError(group.resource->getPath(), ": ", res);
+				script->m_init_failed = true;
 			}
 		}
+		t_current_group = nullptr;
+		t_current_script = nullptr;
+		t_trace = prev_trace;
+		t_host_calls = prev_host_calls;
+		t_wasi_output = prev_wasi_output;
 	}
 
 	void update(float time_delta) override {
 		PROFILE_FUNCTION();
 		if (!m_is_game_running) return;
+		if (!m_input_replay.empty()) time_delta = m_replay_time_step;
+		os::Timer timer;
+		m_frame_stats = {};
+		m_frame_stats.frame = m_frame;
+		t_host_calls = m_frame_stats.host_calls;
+
+		if (m_allocation_tracking) {
+			g_phase_allocations = 0;
+			m_counting_allocator.tracking = true;
+			m3l_setAllocationCallback(countWasm3Allocation);
+		}
+		if (m_trace_path[0]) t_trace = &m_trace;
 
 		processEvents();
+		hotReloadScripts();
+		// instantiation budget is shared by waiting entities, reloads and pools, in this order
+		os::Timer instantiation_timer;
+		instantiateScripts(instantiation_timer);
+		reloadScripts(instantiation_timer);
+		fillPools(instantiation_timer);
 
-		for (auto iter = m_scripts.begin(), end = m_scripts.end(); iter != end; ++iter) {
-			Script& script = iter.value();
-			if (script.m_init_failed) continue;
-			if (!script.m_resource) continue;
-			if (!script.m_resource->isReady()) continue;
+		const u32 max_level = buildGroups();
+		if (m_snapshot_mode) buildSnapshot();
 
-			bool start = false;
-			if (!script.m_runtime) {
-				script.m_runtime = m3_NewRuntime(m_environment, 32 * 1024, this);
-				// TODO optimize - do not parse for each instance
-				auto onError = [&](const char* msg){
-					logError(script.m_resource->getPath(), ": ", msg);
-					script.m_init_failed = true;
-					m3_FreeRuntime(script.m_runtime);
-					script.m_module = nullptr;
-					script.m_runtime = nullptr;
-				};
-				const M3Result parse_res = m3_ParseModule(m_environment, &script.m_module, script.m_resource->m_bytecode.data(), (u32)script.m_resource->m_bytecode.size());
-				if (parse_res != m3Err_none) {
-					onError(parse_res);
-					continue;
-				}
-				const M3Result load_res = m3_LoadModule(script.m_runtime, script.m_module);
-				if (load_res != m3Err_none) {
-					onError(load_res);
+		for (u32 level = 0; level <= max_level; ++level) {
+			m_level_groups.clear();
+			for (ScriptGroup& group : m_groups) {
+				if (group.scripts.empty() || group.level != level) continue;
+				if (skipsTick(group)) {
+					group.skipped_time += time_delta;
+					group.updated = 0;
+					memset(group.host_calls, 0, sizeof(group.host_calls));
+					m_degradation_stats.skipped_updates += group.scripts.size();
 					continue;
 				}
+				m_level_groups.push(&group);
+			}
+			
+			if (!m_parallel_update || m_level_groups.size() < 2) {
+				for (ScriptGroup* group : m_level_groups) updateGroup(*group, time_delta);
+				continue;
+			}
 
-				#define LINK(F) \
-					{ \
-						const M3Result link_res = m3_LinkRawFunction(script.m_module, "LumixAPI", #F, nullptr, &ScriptModuleImpl::API_##F); \
-						if (link_res != m3Err_none && link_res != m3Err_functionLookupFailed) { \
-							onError(link_res); \
-							continue; \
-						} \
-					}
-
-				LINK(setYaw);
-				LINK(setPropertyFloat);
-				LINK(getPropertyFloat);
+			jobs::forEach(m_level_groups.size(), 1, [&](i32 from, i32 to){
+				for (i32 i = from; i < to; ++i) updateGroup(*m_level_groups[i], time_delta);
+			});
+		}
 
-				#undef LINK
+		if (m_snapshot_mode) applyDeferredWrites();
 
-				IM3Global self_global = m3_FindGlobal(script.m_module, "self");
-				if (!self_global) {
-					onError("`self` not found");
-					continue;
-				}
-				
-				M3TaggedValue self_value;
-				self_value.type = c_m3Type_i32;
-				self_value.value.i32 = iter.key().index;
-				M3Result set_self_res = m3_SetGlobal(self_global, &self_value);
-				if (set_self_res != m3Err_none) {
-					onError(set_self_res);
-					continue;
-				}
+		if (m_allocation_tracking) {
+			m3l_setAllocationCallback(nullptr);
+			m_counting_allocator.tracking = false;
+			m_phase_allocations = g_phase_allocations;
+			checkPhaseAllocations();
+		}
 
-				IM3Function tmp_fn;
-				if (m3_FindFunction(&tmp_fn, script.m_runtime, "onMouseMove") == m3Err_none) {
-					m_mouse_move_scripts.push(iter.key());
-				}
-				if (m3_FindFunction(&tmp_fn, script.m_runtime, "onKeyEvent") == m3Err_none) {
-					m_key_input_scripts.push(iter.key());
-				}
-				M3Result find_start_res = m3_FindFunction(&tmp_fn, script.m_runtime, "start");
-				if (find_start_res == m3Err_none) {
-					m3_CallV(tmp_fn);
-				}
+		if (m_trace_path[0]) {
+			t_trace = nullptr;
+			for (ScriptGroup& group : m_groups) {
+				writeTraceEvents(group.trace);
+				group.trace.clear();
 			}
+			writeTraceEvents(m_trace);
+			m_trace.clear();
+		}
+
+		if (m_profile_path[0]) collectProfilerSamples();
+
+		t_host_calls = nullptr;
+		for (ScriptGroup& group : m_groups) flushWASIOutput(group.wasi_output);
+		flushWASIOutput(m_wasi_output);
+		for (const ScriptGroup& group : m_groups) {
+			if (group.scripts.empty()) continue;
+			m_frame_stats.instances_updated += group.updated;
+			for (u32 i = 0; i < ScriptFrameStats::HOST_API_COUNT; ++i) m_frame_stats.host_calls[i] += group.host_calls[i];
+		}
+		if (m_allocation_tracking) m_frame_stats.allocations = m_phase_allocations;
+		m_frame_stats.script_ms = float(timer.getTimeSinceStart() * 1000);
+		m_frame_stats_history[m_frame % lengthOf(m_frame_stats_history)] = m_frame_stats;
+		++m_frame;
+		checkFrameStatsDump();
+		checkFrameBudget();
+	}
+
+	void setFrameBudget(float budget_ms) override {
+		m_frame_budget_ms = budget_ms;
+		m_degradation = DEGRADATION_NONE;
+		m_over_budget_frames = 0;
+		m_under_budget_frames = 0;
+	}
 
-			IM3Function update_fn;
-			M3Result find_update_res = m3_FindFunction(&update_fn, script.m_runtime, "update");
-			if (find_update_res == m3Err_none) {
-				m3_CallV(update_fn, time_delta);
+	u32 getDegradationLevel() const override { return m_degradation; }
+
+	// degrades one step after OVER_BUDGET_FRAMES frames over budget, restores one step after HEADROOM_FRAMES frames
+	// comfortably under budget; reports are logged only on these transitions, not per frame
+	void checkFrameBudget() {
+		if (m_frame_budget_ms <= 0) return;
+
+		const float ms = m_frame_stats.script_ms;
+		m_degradation_stats.worst_ms = maximum(m_degradation_stats.worst_ms, ms);
+		if (ms > m_frame_budget_ms) {
+			++m_degradation_stats.over_budget_frames;
+			++m_over_budget_frames;
+			m_under_budget_frames = 0;
+			if (m_over_budget_frames < OVER_BUDGET_FRAMES || m_degradation == DEGRADATION_COUNT - 1) return;
+			
+			m_over_budget_frames = 0;
+			++m_degradation;
+			logWarning("Scripts exceed the frame budget of ", m_frame_budget_ms, " ms, degraded to level ", m_degradation, " (", DEGRADATION_NAMES[m_degradation], ")");
+			reportDegradation();
+			return;
+		}
+
+		m_over_budget_frames = 0;
+		if (ms > m_frame_budget_ms * HEADROOM) {
+			m_under_budget_frames = 0;
+			return;
+		}
+		++m_under_budget_frames;
+		if (m_under_budget_frames < HEADROOM_FRAMES || m_degradation == DEGRADATION_NONE) return;
+
+		m_under_budget_frames = 0;
+		--m_degradation;
+		logInfo("Scripts are back under the frame budget of ", m_frame_budget_ms, " ms, restored to level ", m_degradation, " (", DEGRADATION_NAMES[m_degradation], ")");
+		reportDegradation();
+	}
+
+	void reportDegradation() {
+		const DegradationStats& stats = m_degradation_stats;
+		logInfo("Since the last report: ", stats.over_budget_frames, " frame(s) over budget, the worst took ", stats.worst_ms, " ms; "
+			, stats.skipped_updates, " update(s) skipped, "
+			, stats.deferred_instantiations, " instantiation(s) deferred, "
+			, stats.skipped_events, " event handler call(s) skipped");
+		m_degradation_stats = {};
+	}
+
+	void checkFrameStatsDump() {
+		if (m_frame_stats_threshold_ms <= 0) return;
+		if (m_frame_stats.script_ms <= m_frame_stats_threshold_ms) return;
+		if (m_last_frame_stats_dump != 0 && m_frame - m_last_frame_stats_dump < lengthOf(m_frame_stats_history)) return;
+
+		m_last_frame_stats_dump = m_frame;
+		logInfo("Frame ", m_frame_stats.frame, " spent ", m_frame_stats.script_ms, " ms in scripts");
+		saveFrameStats(m_frame_stats_path, m_frame_stats_format);
+	}
+
+	void writeFrameStats(OutputMemoryStream& blob, FrameStatsFormat format) const {
+		const u32 capacity = lengthOf(m_frame_stats_history);
+		const u64 count = minimum(m_frame, (u64)capacity);
+		if (format == FrameStatsFormat::CSV) {
+			blob << "frame,script_ms,instances_updated,events_dispatched,set_yaw,set_property_float,get_property_float,"
+				"instantiations,compile_ms,allocations\n";
+		}
+		else {
+			blob << "[";
+		}
+		for (u64 i = m_frame - count; i < m_frame; ++i) {
+			const ScriptFrameStats& stats = m_frame_stats_history[i % capacity];
+			if (format == FrameStatsFormat::CSV) {
+				blob << stats.frame << "," << stats.script_ms << "," << stats.instances_updated << "," << stats.events_dispatched
+					<< "," << stats.host_calls[ScriptFrameStats::SET_YAW]
+					<< "," << stats.host_calls[ScriptFrameStats::SET_PROPERTY_FLOAT]
+					<< "," << stats.host_calls[ScriptFrameStats::GET_PROPERTY_FLOAT]
+					<< "," << stats.instantiations << "," << stats.compile_ms << "," << stats.allocations << "\n";
 			}
-			else if (find_update_res != m3Err_functionLookupFailed) {
-				logError(script.m_resource->getPath(), ": ", find_update_res);
-				script.m_init_failed = true;
+			else {
+				blob << (i == m_frame - count ? "\n" : ",\n")
+					<< "{\"frame\": " << stats.frame
+					<< ", \"script_ms\": " << stats.script_ms
+					<< ", \"instances_updated\": " << stats.instances_updated
+					<< ", \"events_dispatched\": " << stats.events_dispatched
+					<< ", \"host_calls\": {\"setYaw\": " << stats.host_calls[ScriptFrameStats::SET_YAW]
+					<< ", \"setPropertyFloat\": " << stats.host_calls[ScriptFrameStats::SET_PROPERTY_FLOAT]
+					<< ", \"getPropertyFloat\": " << stats.host_calls[ScriptFrameStats::GET_PROPERTY_FLOAT]
+					<< "}, \"instantiations\": " << stats.instantiations
+					<< ", \"compile_ms\": " << stats.compile_ms
+					<< ", \"allocations\": " << stats.allocations
+					<< "}";
 			}
 		}
+		if (format == FrameStatsFormat::JSON) blob << "\n]\n";
+	}
+
+	bool saveFrameStats(const char* path, FrameStatsFormat format) override {
+		OutputMemoryStream blob(m_allocator);
+		writeFrameStats(blob, format);
+
+		os::OutputFile file;
+		if (!file.open(path)) {
+			logError("Failed to create ", path);
+			return false;
+		}
+		const bool success = file.write(blob.data(), blob.size());
+		file.close();
+		if (!success) logError("Failed to write ", path);
+		return success;
+	}
+
+	void setFrameStatsDump(const char* path, FrameStatsFormat format, float threshold_ms) override {
+		copyString(m_frame_stats_path, path);
+		m_frame_stats_format = format;
+		m_frame_stats_threshold_ms = threshold_ms;
+		m_last_frame_stats_dump = 0;
+	}
+
+	void collectProfilerSamples() {
+		const i32 count = minimum((i32)g_profiler_sample_count, MAX_PROFILER_SAMPLES);
+		for (i32 i = 0; i < count; ++i) {
+			const ProfilerSample& sample = g_profiler_samples[i];
+			u32 offset;
+			u32 node = ScriptResource::NodeCodeRange::NO_NODE;
+			if (m3l_mapPCToOffset(sample.runtime, sample.pc, &offset)) node = sample.resource->findNode(offset);
+
+			const Path& path = sample.resource->getPath();
+			const i32 idx = m_profile.find([&](const NodeSamples& s){ return s.node == node && s.resource == path; });
+			if (idx < 0) m_profile.push({path, node, 1});
+			else ++m_profile[idx].samples;
+		}
+		g_profiler_sample_count = 0;
+	}
+
+	bool saveProfile() {
+		OutputMemoryStream blob(m_allocator);
+		for (const NodeSamples& s : m_profile) {
+			blob << "{\"resource\": \"" << s.resource.c_str() << "\""
+				<< ", \"node\": " << (s.node == ScriptResource::NodeCodeRange::NO_NODE ? -1 : (i32)s.node)
+				<< ", \"samples\": " << s.samples
+				<< "}\n";
+		}
+
+		os::OutputFile file;
+		if (!file.open(m_profile_path)) {
+			logError("Failed to create ", m_profile_path);
+			return false;
+		}
+		const bool success = file.write(blob.data(), blob.size());
+		file.close();
+		if (!success) logError("Failed to write ", m_profile_path);
+		else logInfo("Script profile written to ", m_profile_path);
+		return success;
+	}
+
+	// events are converted to chrome trace format every frame, while the resources they reference are still alive
+	void writeTraceEvents(Span<const TraceEvent> events) {
+		const double to_us = 1e6 / os::Timer::getFrequency();
+		for (const TraceEvent& e : events) {
+			if (!m_trace_json.empty()) m_trace_json << ",\n";
+			m_trace_json << "{\"name\": \"" << e.name << "\", \"cat\": \"script\", \"ph\": \"X\", \"pid\": 0"
+				<< ", \"tid\": " << e.thread
+				<< ", \"ts\": " << double(e.begin - m_trace_start) * to_us
+				<< ", \"dur\": " << double(e.end - e.begin) * to_us
+				<< ", \"args\": {\"entity\": " << e.entity.index
+				<< ", \"resource\": \"" << (e.resource ? e.resource->getPath().c_str() : "") << "\"}}";
+		}
+	}
+
+	bool saveTrace() {
+		os::OutputFile file;
+		if (!file.open(m_trace_path)) {
+			logError("Failed to create ", m_trace_path);
+			return false;
+		}
+		const char* header = "{\"traceEvents\": [\n";
+		const char* footer = "\n]}\n";
+		bool success = file.write(header, stringLength(header));
+		success = file.write(m_trace_json.data(), m_trace_json.size()) && success;
+		success = file.write(footer, stringLength(footer)) && success;
+		file.close();
+		if (!success) logError("Failed to write ", m_trace_path);
+		else logInfo("Script trace written to ", m_trace_path);
+		return success;
+	}
+
+	// after warm-up (instantiation, arrays reaching their final capacity) the script phase should not allocate
+	void checkPhaseAllocations() {
+		static constexpr u32 WARMUP_FRAMES = 60;
+		if (m_tracked_frames < WARMUP_FRAMES) {
+			++m_tracked_frames;
+			return;
+		}
+		if (m_phase_allocations == 0) return;
+		if (m_tracked_frames > WARMUP_FRAMES) return;
+
+		// report only the first such frame
+		++m_tracked_frames;
+		logError("Script phase made ", m_phase_allocations, " allocation(s) after warm-up");
 	}
 
 	void destroyScript(EntityRef entity) {
 		m_mouse_move_scripts.eraseItem(entity);
 		m_key_input_scripts.eraseItem(entity);
+		freeRuntime(m_scripts[entity]);
+		eraseSavedGlobals(entity);
 		m_scripts.erase(entity);
 		m_world.onComponentDestroyed(entity, SCRIPT_TYPE, this);
 	}
@@ -316,6 +2519,11 @@ struct ScriptModuleImpl : ScriptModule {
 
 	void setScriptResource(EntityRef entity, const Path& path) {
 		Script& script = m_scripts[entity];
+		m_mouse_move_scripts.eraseItem(entity);
+		m_key_input_scripts.eraseItem(entity);
+		freeRuntime(script);
+		eraseSavedGlobals(entity);
+		script.m_init_failed = false;
 		if (script.m_resource) script.m_resource->decRefCount();
 		if (path.isEmpty()) {
 			script.m_resource = nullptr;
@@ -324,12 +2532,19 @@ struct ScriptModuleImpl : ScriptModule {
 		script.m_resource = m_engine.getResourceManager().load<ScriptResource>(path);
 	}
 
+	void assignScriptResource(EntityRef entity, ScriptResource& resource) override {
+		setScriptResource(entity, Path());
+		resource.incRefCount();
+		m_scripts[entity].m_resource = &resource;
+	}
+
 	Path getScriptResource(EntityRef entity) {
 		Script& script = m_scripts[entity];
 		ScriptResource* res = script.m_resource;
 		return res ? res->getPath() : Path();
 	}
 
+	CountingAllocator m_counting_allocator;
 	IAllocator& m_allocator;
 	Engine& m_engine;
 	ISystem& m_system;
@@ -337,24 +2552,69 @@ struct ScriptModuleImpl : ScriptModule {
 	HashMap<EntityRef, Script> m_scripts;
 	Array<EntityRef> m_mouse_move_scripts;
 	Array<EntityRef> m_key_input_scripts;
+	Array<ScriptGroup> m_groups;
+	HashMap<ScriptResource*, u32> m_group_indices;
+	Array<ScriptGroup*> m_level_groups;
+	Array<PropertySnapshot> m_snapshot;
+	Array<ScriptPool> m_pools;
+	// replacements of instances of reloaded resources, see reloadScripts
+	HashMap<EntityRef, Script> m_reloads;
+	OutputMemoryStream m_reload_state;
+	// resources with settings made through the module, kept loaded so the settings are not lost
+	Array<ScriptResource*> m_configured_resources;
 	bool m_is_game_running = false;
+	bool m_parallel_update = false;
+	bool m_snapshot_mode = false;
+	bool m_allocation_tracking = false;
+	u32 m_tracked_frames = 0;
+	u32 m_phase_allocations = 0;
+	char m_input_recording_path[MAX_PATH] = "";
+	OutputMemoryStream m_input_recording;
+	u32 m_recorded_frames = 0;
+	OutputMemoryStream m_input_replay;
+	u64 m_replay_offset = 0;
+	u32 m_replay_frames = 0;
+	u32 m_replayed_frames = 0;
+	float m_replay_time_step = 1 / 60.f;
+	char m_trace_path[MAX_PATH] = "";
+	// events of the main thread, worker threads use ScriptGroup::trace
+	Array<TraceEvent> m_trace;
+	OutputMemoryStream m_trace_json;
+	u64 m_trace_start = 0;
+	char m_profile_path[MAX_PATH] = "";
+	Array<NodeSamples> m_profile;
+	u64 m_frame = 0;
+	// stats of the current frame
+	ScriptFrameStats m_frame_stats;
+	// ring buffer, the frame `i` is at `i % lengthOf(m_frame_stats_history)`
+	ScriptFrameStats m_frame_stats_history[600];
+	char m_frame_stats_path[MAX_PATH] = "";
+	FrameStatsFormat m_frame_stats_format = FrameStatsFormat::CSV;
+	float m_frame_stats_threshold_ms = 0;
+	u64 m_last_frame_stats_dump = 0;
+	float m_frame_budget_ms = 0;
+	float m_instantiation_budget_ms = 0;
+	u32 m_degradation = DEGRADATION_NONE;
+	u32 m_over_budget_frames = 0;
+	u32 m_under_budget_frames = 0;
+	DegradationStats m_degradation_stats;
+	// globals of deserialized or reactivated instances which have not started yet, see restoreGlobals
+	OutputMemoryStream m_saved_globals;
+	HashMap<EntityRef, SavedGlobals> m_saved_globals_ranges;
+	// bytes of m_saved_globals referenced by m_saved_globals_ranges
+	u32 m_saved_globals_live = 0;
+	// state of instances in inactive partitions, sequence of (entity, state size, saveGlobals output)
+	HashMap<u32, OutputMemoryStream> m_inactive_partitions;
+	// holds a reference to each resource
+	HashMap<ScriptResource*, ParsedScript> m_parsed_scripts;
+	// WASI output of scripts running on the main thread, see WASI_fdWrite
+	OutputMemoryStream m_wasi_output;
+	u64 m_wasi_clock_start = 0;
+	// ScriptManager::getDataGeneration when scripts were last checked for hot reload
+	u32 m_data_generation = 0xffFFffFF;
 	IM3Environment m_environment = nullptr;
 };
 
-struct ScriptManager : ResourceManager {
-	ScriptManager(IAllocator& allocator)
-		: ResourceManager(allocator)
-	{}
-
-	Resource* createResource(const Path& path) override {
-		return LUMIX_NEW(m_allocator, ScriptResource)(path, *this, m_allocator);
-	}
-
-	void destroyResource(Resource& resource) override {
-		LUMIX_DELETE(m_allocator, &resource);
-	}
-};
-
 struct VisualScriptPlugin : ISystem {
 	VisualScriptPlugin(Engine& engine)
 		: m_engine(engine)
@@ -368,21 +2628,107 @@ struct VisualScriptPlugin : ISystem {
 	
 		LUMIX_MODULE(ScriptModuleImpl, "script")
 			.LUMIX_CMP(Script, "script", "Script")
-				.LUMIX_PROP(ScriptResource, "Script").resourceAttribute(ScriptResource::TYPE);
+				.LUMIX_PROP(ScriptResource, "Script").resourceAttribute(ScriptResource::TYPE)
+				.LUMIX_PROP(ScriptPartition, "Partition");
 	}
 
 	const char* getName() const override { return "script"; }
+
+	void initEnd() override {
+		char cmd_line[2048];
+		if (!os::getCommandLine(Span(cmd_line))) return;
+
+		char output_path[MAX_PATH] = "";
+		char baseline_path[MAX_PATH] = "";
+		char input_path[MAX_PATH] = "";
+		CommandLineParser parser(cmd_line);
+		while (parser.next()) {
+			if (parser.currentEquals("-visualscript_benchmark")) {
+				if (!parser.next()) break;
+				parser.getCurrent(output_path, lengthOf(output_path));
+			}
+			else if (parser.currentEquals("-visualscript_benchmark_baseline")) {
+				if (!parser.next()) break;
+				parser.getCurrent(baseline_path, lengthOf(baseline_path));
+			}
+			else if (parser.currentEquals("-visualscript_benchmark_input")) {
+				if (!parser.next()) break;
+				parser.getCurrent(input_path, lengthOf(input_path));
+			}
+			else if (parser.currentEquals("-visualscript_record_input")) {
+				if (!parser.next()) break;
+				parser.getCurrent(m_record_input_path, lengthOf(m_record_input_path));
+			}
+			else if (parser.currentEquals("-visualscript_replay_input")) {
+				if (!parser.next()) break;
+				parser.getCurrent(m_replay_input_path, lengthOf(m_replay_input_path));
+			}
+			else if (parser.currentEquals("-visualscript_trace")) {
+				if (!parser.next()) break;
+				parser.getCurrent(m_trace_path, lengthOf(m_trace_path));
+			}
+			else if (parser.currentEquals("-visualscript_profile")) {
+				if (!parser.next()) break;
+				parser.getCurrent(m_profile_path, lengthOf(m_profile_path));
+			}
+			else if (parser.currentEquals("-visualscript_frame_stats")) {
+				if (!parser.next()) break;
+				parser.getCurrent(m_frame_stats_path, lengthOf(m_frame_stats_path));
+			}
+			else if (parser.currentEquals("-visualscript_budget")) {
+				if (!parser.next()) break;
+				char tmp[32];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				m_frame_budget_ms = (float)atof(tmp);
+			}
+			else if (parser.currentEquals("-visualscript_instantiation_budget")) {
+				if (!parser.next()) break;
+				char tmp[32];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				m_instantiation_budget_ms = (float)atof(tmp);
+			}
+			else if (parser.currentEquals("-visualscript_frame_stats_threshold")) {
+				if (!parser.next()) break;
+				char tmp[32];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				m_frame_stats_threshold_ms = (float)atof(tmp);
+			}
+		}
+
+		if (output_path[0]) {
+			runScriptBenchmarks(m_engine, output_path, baseline_path[0] ? baseline_path : nullptr, input_path[0] ? input_path : nullptr);
+		}
+	}
+
 	void serialize(OutputMemoryStream& serializer) const override {}
 	bool deserialize(i32 version, InputMemoryStream& serializer) override { return version == 0; }
 
 	void createModules(World& world) override {
 		UniquePtr<ScriptModule> module = UniquePtr<ScriptModuleImpl>::create(m_allocator, *this, m_engine, world, m_allocator);
+		if (m_record_input_path[0]) module->recordInput(m_record_input_path);
+		if (m_replay_input_path[0]) module->replayInput(m_replay_input_path, 1 / 60.f);
+		if (m_trace_path[0]) module->traceExecution(m_trace_path);
+		if (m_profile_path[0]) module->profileExecution(m_profile_path);
+		if (m_frame_budget_ms > 0) module->setFrameBudget(m_frame_budget_ms);
+		if (m_instantiation_budget_ms > 0) module->setInstantiationBudget(m_instantiation_budget_ms);
+		if (m_frame_stats_path[0]) {
+			const FrameStatsFormat format = endsWithInsensitive(m_frame_stats_path, ".csv") ? FrameStatsFormat::CSV : FrameStatsFormat::JSON;
+			module->setFrameStatsDump(m_frame_stats_path, format, m_frame_stats_threshold_ms);
+		}
 		world.addModule(module.move());
 	}
 
 	IAllocator& m_allocator;
 	Engine& m_engine;
 	ScriptManager m_script_manager;
+	char m_record_input_path[MAX_PATH] = "";
+	char m_replay_input_path[MAX_PATH] = "";
+	char m_trace_path[MAX_PATH] = "";
+	char m_profile_path[MAX_PATH] = "";
+	char m_frame_stats_path[MAX_PATH] = "";
+	float m_frame_stats_threshold_ms = 0;
+	float m_frame_budget_ms = 0;
+	float m_instantiation_budget_ms = 0;
 };
 
 LUMIX_PLUGIN_ENTRY(visualscript) {
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "core/array.h"
+#include "core/hash.h"
+#include "core/string.h"
 #include "engine/plugin.h"
 #include "../external/wasm3.h"
 
@@ -15,7 +18,13 @@ enum class ScriptValueType : u32 {
 struct ScriptResource : Resource {
 	static ResourceType TYPE;
 
+	// files are written with LAST, which becomes the value of the next entry once it's added,
+	// so a file has a feature if its version is greater than the feature's entry
 	enum class Version : u32 {
+		FIRST,
+		ACCESS_SET,
+		METADATA,
+		VALIDATION,
 
 		LAST
 	};
@@ -27,14 +36,201 @@ struct ScriptResource : Resource {
 		Version version = Version::LAST;
 	};
 
+	// world state a script touches through LumixAPI, used to schedule scripts in parallel
+	struct AccessSet {
+		enum Flags : u32 {
+			NONE = 0,
+			READ_TRANSFORM = 1 << 0,
+			WRITE_TRANSFORM = 1 << 1,
+			// e.g. hand-written wasm, such scripts never run concurrently with anything
+			UNKNOWN = 1 << 2
+		};
+
+		AccessSet(IAllocator& allocator);
+
+		void clear();
+		void addRead(StableHash property);
+		void addWrite(StableHash property);
+		bool conflicts(const AccessSet& rhs) const;
+		void serialize(OutputMemoryStream& blob) const;
+		void deserialize(InputMemoryStream& blob);
+
+		u32 flags = UNKNOWN;
+		Array<StableHash> reads;
+		Array<StableHash> writes;
+	};
+
+	// precomputed by the compiler, so instances are set up and inspected without looking anything up by name
+	struct Metadata {
+		enum class EntryPoint : u32 {
+			UPDATE,
+			MOUSE_MOVE,
+			KEY_EVENT,
+			START,
+
+			COUNT
+		};
+
+		static constexpr const char* ENTRY_POINT_NAMES[] = { "update", "onMouseMove", "onKeyEvent", "start" };
+		static constexpr u32 NONE = 0xffFFffFF;
+		// used if stack_size is unknown
+		static constexpr u32 DEFAULT_STACK_SIZE = 32 * 1024;
+
+		struct Global {
+			Global(IAllocator& allocator) : name(allocator) {}
+
+			String name;
+			ScriptValueType type;
+			// index in the wasm global section
+			u32 index;
+		};
+
+		struct Import {
+			Import(IAllocator& allocator) : module(allocator), field(allocator) {}
+
+			String module;
+			String field;
+			// wasm function index
+			u32 function;
+			// ScriptFrameStats::HostAPI, resolved on load, not serialized
+			u32 api = NONE;
+		};
+
+		Metadata(IAllocator& allocator);
+
+		void clear();
+		void serialize(OutputMemoryStream& blob) const;
+		void deserialize(InputMemoryStream& blob);
+
+		IAllocator& allocator;
+		// false for resources compiled before Version::METADATA and for hand-written wasm
+		bool valid = false;
+		// wasm function index of each entry point, NONE if not exported;
+		// exported entry points are also the events the script subscribes to
+		u32 entry_points[(u32)EntryPoint::COUNT];
+		u32 self_global = NONE;
+		// bytes, 0 = unknown
+		u32 stack_size = 0;
+		// named globals only
+		Array<Global> globals;
+		Array<Import> imports;
+	};
+
+	// code of graph node `node` starts at `offset` in the wasm module and runs until the next range
+	struct NodeCodeRange {
+		static constexpr u32 NO_NODE = 0xffFFffFF;
+
+		u32 offset;
+		u32 node;
+	};
+
+	// written after Metadata by the asset compiler, which parses and compiles the wasm module the same way
+	// the runtime does and checks that its frames fit in the stack
+	struct Validation {
+		bool validated = false;
+		// of the wasm module, so a modified or corrupted module is not trusted
+		StableHash hash;
+	};
+
+	// compiled file, shared by all resources with identical content, see ScriptManager
+	struct SharedData {
+		SharedData(IAllocator& allocator) : content(allocator) {}
+
+		OutputMemoryStream content;
+		// of the wasm module in `content`, computed once by parseData and used for both sharing and Validation
+		StableHash hash;
+		u32 ref_count = 0;
+	};
+
+	// wasm custom section with NodeCodeRange entries, written by the graph compiler
+	static constexpr const char* NODE_MAP_SECTION = "lumix_nodes";
+
+	enum class Priority : u32 {
+		NORMAL,
+		// cosmetic scripts, degraded first when scripts exceed the frame budget, see ScriptModule::setFrameBudget
+		LOW
+	};
+
 	ScriptResource(const Path& path, ResourceManager& resource_manager, IAllocator& allocator);
+	~ScriptResource();
 
 	ResourceType getType() const override { return TYPE; }
 	void unload() override;
 	bool load(Span<const u8> mem) override;
+	// creates the resource from compiled data in memory, without going through the file system
+	bool create(Span<const u8> compiled);
+	// same as above, but takes ownership of `compiled`, so the bytecode is not copied
+	bool create(OutputMemoryStream&& compiled);
+	// graph node which generated code at `offset` in m_bytecode, NodeCodeRange::NO_NODE if unknown
+	u32 findNode(u32 offset) const;
+	// used by the asset compiler to fill Validation, returns null if `wasm` is valid and its frames fit in `stack_size`;
+	// `max_frame_size` is set to the deepest compiled frame in bytes, also if it does not fit
+	static M3Result validate(Span<const u8> wasm, u32 stack_size, u32* max_frame_size = nullptr);
+	// stack size of instances, m_metadata.stack_size is trusted only if it was validated
+	u32 getStackSize() const;
 
 	IAllocator& m_allocator;
-	OutputMemoryStream m_bytecode;
+	AccessSet m_access_set;
+	Metadata m_metadata;
+	// max size of linear memory of a single instance in bytes, 0 = no limit; applies to instances created after it's set,
+	// see ScriptModule::setScriptMemoryLimit
+	u32 m_memory_limit = 0;
+	// see ScriptModule::setScriptPriority
+	Priority m_priority = Priority::NORMAL;
+	// validated by the asset compiler, so m_metadata.stack_size can be trusted and instances skip evaluation
+	// of global initializers, which validation already did
+	bool m_validated = false;
+	// incremented on every (re)load, instances of an older generation are hot reloaded, see Script::m_generation
+	u32 m_generation = 0;
+	// whole compiled file, including the header
+	SharedData* m_data = nullptr;
+	// wasm module in m_data, wasm3 references it in place, so it must outlive parsing and compilation of all modules;
+	// fully compiled instances do not touch it, so they can keep running while the resource reloads
+	Span<const u8> m_bytecode;
+	// sorted by offset, empty for scripts not compiled from a graph
+	Array<NodeCodeRange> m_node_map;
+
+private:
+	bool parseData(Span<const u8> content, u32& module_offset, StableHash& module_hash);
+	void setData(SharedData* data, u32 module_offset);
+	void releaseData();
+};
+
+struct ScriptMemoryStats {
+	u64 total() const { return stack + code + globals + linear_memory; }
+
+	u32 instances = 0;
+	u64 stack = 0;
+	u64 code = 0;
+	u64 globals = 0;
+	u64 linear_memory = 0;
+};
+
+// totals of a single update of ScriptModule, see ScriptModule::saveFrameStats
+struct ScriptFrameStats {
+	enum HostAPI : u32 {
+		SET_YAW,
+		SET_PROPERTY_FLOAT,
+		GET_PROPERTY_FLOAT,
+
+		HOST_API_COUNT
+	};
+
+	u64 frame = 0;
+	float script_ms = 0;
+	u32 instances_updated = 0;
+	u32 events_dispatched = 0;
+	u32 host_calls[HOST_API_COUNT] = {};
+	u32 instantiations = 0;
+	// parse, load, link and compile of new instances, including pooled ones
+	float compile_ms = 0;
+	// only counted with allocation tracking, see ScriptModule::setAllocationTracking
+	u32 allocations = 0;
+};
+
+enum class FrameStatsFormat : u32 {
+	CSV,
+	JSON
 };
 
 struct Script {
@@ -45,12 +241,100 @@ struct Script {
 	bool m_init_failed = false;
 	IM3Runtime m_runtime = nullptr;
 	IM3Module m_module = nullptr;
+	// entry points are looked up (and compiled) once, when the script is instantiated
+	IM3Function m_update_fn = nullptr;
+	IM3Function m_mouse_move_fn = nullptr;
+	IM3Function m_key_event_fn = nullptr;
+	IM3Function m_start_fn = nullptr;
+	IM3Global m_self_global = nullptr;
+	// instantiation can be spread over several frames, see ScriptModule::setInstantiationBudget
+	enum class LoadStage : u8 {
+		NONE,
+		PARSE,
+		COMPILE,
+		READY
+	};
+	LoadStage m_load_stage = LoadStage::NONE;
+	// next function to compile in LoadStage::COMPILE
+	u32 m_load_function = 0;
+	// instances are created only while their partition is active, see ScriptModule::deactivatePartition
+	u32 m_partition = 0;
+	// ScriptResource::m_generation the instance was created from
+	u32 m_generation = 0;
 	ScriptResource* m_resource = nullptr;
+	// range in the module's property snapshot, valid only during the update phase
+	u32 m_snapshot_offset = 0;
+	u32 m_snapshot_count = 0;
 };
 
 struct ScriptModule : IModule {
 	virtual Script& getScript(EntityRef entity) = 0;
+	// like setting the Script property, but with a resource which does not have to exist on disk, e.g. ScriptResource::create
+	virtual void assignScriptResource(EntityRef entity, ScriptResource& resource) = 0;
+	// run independent scripts on worker threads, see ScriptResource::AccessSet; off by default, because without
+	// snapshot mode the writes go to the live world, whose callbacks (e.g. other modules' entity-moved handlers)
+	// are not covered by the access sets
+	virtual void setParallelUpdate(bool enable) = 0;
+	// scripts read properties from a copy made before update and their writes are applied after update,
+	// so all scripts can run concurrently, but they see the state from before the update phase
+	virtual void setSnapshotMode(bool enable) = 0;
+	// keeps `count` instances of the script parsed, linked and compiled, so spawnScript does not have to;
+	// the pool is filled in the next update, spawned instances are replaced only within setInstantiationBudget
+	virtual void reservePool(const Path& script, u32 count) = 0;
+	// creates the script component on `entity`, returns true if the instance was taken from the pool,
+	// otherwise the script is instantiated lazily in the next update
+	virtual bool spawnScript(EntityRef entity, const Path& script) = 0;
+	// debug mode, counts heap allocations made by the module and wasm3 during update; logs an error if
+	// the count is not zero after warm-up; allocations made by the engine (e.g. logging) are not counted
+	virtual void setAllocationTracking(bool enable) = 0;
+	// allocations made during the last update, valid only if allocation tracking is enabled
+	virtual u32 getPhaseAllocations() const = 0;
+	virtual ScriptMemoryStats getInstanceMemoryStats(EntityRef entity) = 0;
+	// sum of all instances of the script in this module, including pooled instances
+	virtual ScriptMemoryStats getResourceMemoryStats(const Path& script) = 0;
+	// max size of linear memory of a single instance of `script` in bytes, 0 = no limit; applies to instances created
+	// afterwards, see ScriptResource::m_memory_limit; the module keeps `script` loaded, so the limit survives reloads
+	virtual void setScriptMemoryLimit(const Path& script, u32 limit) = 0;
+	// see ScriptResource::Priority; like the memory limit, the module keeps `script` loaded, so the priority survives reloads
+	virtual void setScriptPriority(const Path& script, ScriptResource::Priority priority) = 0;
+	// records input events dispatched to scripts, one entry per update, the recording is written to `path` when the game stops
+	virtual void recordInput(const char* path) = 0;
+	// scripts get events from the recording instead of the input system, one recorded frame per update,
+	// and updates use `time_step` instead of the engine's time delta, so sessions are reproducible
+	virtual bool replayInput(const char* path, float time_step) = 0;
+	// true while there are recorded frames left
+	virtual bool isReplayingInput() const = 0;
+	// records every call into scripts (`start`, `update`, event handlers) and every LumixAPI call,
+	// with entity, resource and thread; written to `path` as chrome trace events when the game stops
+	virtual void traceExecution(const char* path) = 0;
+	// samples the running script periodically and maps the samples to graph nodes, per-resource and per-node
+	// sample counts are written to `path` when the game stops; Linux only, one profiling module at a time
+	virtual void profileExecution(const char* path) = 0;
+	// writes stats of the last frames, oldest first, see ScriptFrameStats
+	virtual bool saveFrameStats(const char* path, FrameStatsFormat format) = 0;
+	// saves frame stats to `path` when time spent in scripts in a single frame exceeds `threshold_ms`,
+	// at most once per the number of frames the stats keep; `threshold_ms` = 0 disables it
+	virtual void setFrameStatsDump(const char* path, FrameStatsFormat format, float threshold_ms) = 0;
+	// when scripts take longer than `budget_ms` for several frames in a row, the module degrades step by step:
+	// low priority scripts are updated less often, then instantiation is spread over frames, then event handlers
+	// of low priority scripts are skipped; steps are undone when there's headroom again; 0 disables it
+	virtual void setFrameBudget(float budget_ms) = 0;
+	// 0 - not degraded, see setFrameBudget
+	virtual u32 getDegradationLevel() const = 0;
+	// scripts are parsed and compiled a section / function at a time until `budget_ms` is spent in a frame,
+	// the rest continues in the next frame and an instance starts once it's complete; 0 - no limit
+	virtual void setInstantiationBudget(float budget_ms) = 0;
+	// scripts can be grouped to partitions, e.g. streamed regions of an open world; 0 is the default partition;
+	// the script's saved globals move with it, also between inactive partitions
+	virtual void setScriptPartition(EntityRef entity, u32 partition) = 0;
+	virtual u32 getScriptPartition(EntityRef entity) = 0;
+	// tears down instances in `partition` and keeps their globals in a compact per-partition blob;
+	// components stay, but no instance is created for them until the partition is activated again
+	virtual void deactivatePartition(u32 partition) = 0;
+	// instances in `partition` are created again (spread over frames with setInstantiationBudget), with their globals restored
+	virtual void activatePartition(u32 partition) = 0;
+	virtual bool isPartitionActive(u32 partition) const = 0;
 };
 
 
-} // namespace Lumix
\ No newline at end of file
+} // namespace Lumix
@@ -0,0 +1,1272 @@
+#include "core/array.h"
+#include "core/log.h"
+#include "core/os.h"
+#include "core/profiler.h"
+#include "core/stream.h"
+#include "core/string.h"
+#include "engine/engine.h"
+#include "engine/file_system.h"
+#include "engine/input_system.h"
+#include "engine/reflection.h"
+#include "engine/resource_manager.h"
+#include "engine/world.h"
+#include "script.h"
+#include "script_benchmark.h"
+#include <float.h>
+#include <lua.h>
+#include <stdlib.h>
+
+namespace Lumix {
+
+static const ComponentType SCRIPT_TYPE = reflection::getComponentType("script");
+
+namespace {
+
+enum class WasmSection : u8 {
+	TYPE = 1,
+	IMPORT = 2,
+	FUNCTION = 3,
+	GLOBAL = 6,
+	EXPORT = 7,
+	CODE = 10
+};
+
+enum class WasmExternalType : u8 {
+	FUNCTION = 0,
+	GLOBAL = 3
+};
+
+enum class WasmType : u8 {
+	F32 = 0x7D,
+	I64 = 0x7E,
+	I32 = 0x7F
+};
+
+enum class WasmOp : u8 {
+	LOOP = 0x03,
+	END = 0x0B,
+	BR_IF = 0x0D,
+	CALL = 0x10,
+	DROP = 0x1A,
+	LOCAL_GET = 0x20,
+	LOCAL_SET = 0x21,
+	LOCAL_TEE = 0x22,
+	GLOBAL_GET = 0x23,
+	GLOBAL_SET = 0x24,
+	I32_CONST = 0x41,
+	I64_CONST = 0x42,
+	F32_CONST = 0x43,
+	I32_LT_S = 0x48,
+	I32_ADD = 0x6A,
+	F32_ADD = 0x92,
+	F32_SUB = 0x93,
+	F32_MUL = 0x94,
+	F32_CONVERT_I32_S = 0xB2
+};
+
+// function indices of LumixAPI imports, in the same order as the graph compiler imports them
+enum class LumixAPI : u32 {
+	SET_YAW,
+	SET_PROPERTY_FLOAT,
+	GET_PROPERTY_FLOAT
+};
+
+static void writeULEB128(OutputMemoryStream& blob, u64 val) {
+	do {
+		u8 byte = val & 0x7f;
+		val >>= 7;
+		if (val != 0) byte |= 0x80;
+		blob.write(byte);
+	} while (val != 0);
+}
+
+static void writeSLEB128(OutputMemoryStream& blob, i64 val) {
+	bool end;
+	do {
+		u8 byte = val & 0x7f;
+		val >>= 7;
+		end = (val == 0 && (byte & 0x40) == 0) || (val == -1 && (byte & 0x40) != 0);
+		if (!end) byte |= 0x80;
+		blob.write(byte);
+	} while (!end);
+}
+
+// body of a single function
+struct WasmCode {
+	WasmCode(IAllocator& allocator) : blob(allocator) {}
+
+	// must be the first thing written
+	WasmCode& locals(u32 i32_count, u32 f32_count) {
+		writeULEB128(blob, (i32_count > 0 ? 1 : 0) + (f32_count > 0 ? 1 : 0));
+		if (i32_count > 0) {
+			writeULEB128(blob, i32_count);
+			blob.write(WasmType::I32);
+		}
+		if (f32_count > 0) {
+			writeULEB128(blob, f32_count);
+			blob.write(WasmType::F32);
+		}
+		return *this;
+	}
+
+	WasmCode& op(WasmOp op) { blob.write(op); return *this; }
+	WasmCode& localGet(u32 idx) { op(WasmOp::LOCAL_GET); writeULEB128(blob, idx); return *this; }
+	WasmCode& localSet(u32 idx) { op(WasmOp::LOCAL_SET); writeULEB128(blob, idx); return *this; }
+	WasmCode& localTee(u32 idx) { op(WasmOp::LOCAL_TEE); writeULEB128(blob, idx); return *this; }
+	WasmCode& globalGet(u32 idx) { op(WasmOp::GLOBAL_GET); writeULEB128(blob, idx); return *this; }
+	WasmCode& globalSet(u32 idx) { op(WasmOp::GLOBAL_SET); writeULEB128(blob, idx); return *this; }
+	WasmCode& self() { return globalGet(0); }
+	WasmCode& i32Const(i32 value) { op(WasmOp::I32_CONST); writeSLEB128(blob, value); return *this; }
+	WasmCode& i64Const(u64 value) { op(WasmOp::I64_CONST); writeSLEB128(blob, (i64)value); return *this; }
+	WasmCode& f32Const(float value) { op(WasmOp::F32_CONST); blob.write(value); return *this; }
+	WasmCode& call(LumixAPI fn) { op(WasmOp::CALL); writeULEB128(blob, (u32)fn); return *this; }
+	// block type void
+	WasmCode& loop() { op(WasmOp::LOOP); blob.write(u8(0x40)); return *this; }
+	WasmCode& brIf(u32 depth) { op(WasmOp::BR_IF); writeULEB128(blob, depth); return *this; }
+
+	OutputMemoryStream blob;
+};
+
+// compiled script shaped like the output of the graph compiler - LumixAPI imports, exported `self` global and entry points
+struct WasmModule {
+	struct Function {
+		Function(IAllocator& allocator) : code(allocator) {}
+
+		const char* name = nullptr;
+		u32 num_args = 0;
+		WasmType args[2];
+		WasmCode code;
+	};
+
+	WasmModule(IAllocator& allocator)
+		: m_allocator(allocator)
+		, m_functions(allocator)
+		, m_globals(allocator)
+		, m_access_set(allocator)
+	{
+		m_access_set.flags = ScriptResource::AccessSet::NONE;
+	}
+
+	WasmCode& addFunction(const char* name, Span<const WasmType> args) {
+		Function& fn = m_functions.emplace(m_allocator);
+		fn.name = name;
+		ASSERT(args.length() <= lengthOf(fn.args));
+		for (WasmType arg : args) fn.args[fn.num_args++] = arg;
+		return fn.code;
+	}
+
+	// mutable f32 global, returns its index; index 0 is `self`
+	u32 addGlobal(float value) {
+		m_globals.push(value);
+		return m_globals.size();
+	}
+
+	template <typename F>
+	void writeSection(OutputMemoryStream& blob, WasmSection section, F f) const {
+		OutputMemoryStream tmp(m_allocator);
+		f(tmp);
+		blob.write(section);
+		writeULEB128(blob, tmp.size());
+		blob.write(tmp.data(), tmp.size());
+	}
+
+	static void writeString(OutputMemoryStream& blob, const char* value) {
+		const i32 len = stringLength(value);
+		writeULEB128(blob, len);
+		blob.write(value, len);
+	}
+
+	// writes the whole compiled resource, i.e. including ScriptResource::Header;
+	// older `version` writes only what the compiler wrote at that version
+	void write(OutputMemoryStream& blob, ScriptResource::Version version = ScriptResource::Version::LAST) const {
+		using Version = ScriptResource::Version;
+		ScriptResource::Header header;
+		header.version = version;
+		blob.write(header);
+		if (version > Version::ACCESS_SET) m_access_set.serialize(blob);
+		if (version > Version::METADATA) {
+			ScriptResource::Metadata metadata(m_allocator);
+			fillMetadata(metadata);
+			metadata.serialize(blob);
+		}
+		OutputMemoryStream wasm(m_allocator);
+		writeWasm(wasm);
+		// validated like the asset compiler does, so instances are set up like shipped scripts
+		ScriptResource::Validation validation;
+		const Span<const u8> wasm_span(wasm.data(), (u32)wasm.size());
+		if (ScriptResource::validate(wasm_span, ScriptResource::Metadata::DEFAULT_STACK_SIZE) == m3Err_none) {
+			validation.validated = true;
+			validation.hash = StableHash(wasm_span.begin(), wasm_span.length());
+		}
+		if (version > Version::VALIDATION) blob.write(validation);
+		blob.write(wasm.data(), wasm.size());
+	}
+
+	// same as the graph compiler's, except stack size, which is left to the default
+	void fillMetadata(ScriptResource::Metadata& metadata) const {
+		using Metadata = ScriptResource::Metadata;
+		metadata.clear();
+		metadata.valid = true;
+		for (const Function& fn : m_functions) {
+			for (u32 i = 0; i < (u32)Metadata::EntryPoint::COUNT; ++i) {
+				if (equalStrings(fn.name, Metadata::ENTRY_POINT_NAMES[i])) metadata.entry_points[i] = 3 + u32(&fn - m_functions.begin());
+			}
+		}
+		metadata.self_global = 0;
+		Metadata::Global& self = metadata.globals.emplace(m_allocator);
+		self.name = "self";
+		self.type = ScriptValueType::ENTITY;
+		self.index = 0;
+		const char* names[] = { "setYaw", "setPropertyFloat", "getPropertyFloat" };
+		for (u32 i = 0; i < lengthOf(names); ++i) {
+			Metadata::Import& import = metadata.imports.emplace(m_allocator);
+			import.module = "LumixAPI";
+			import.field = names[i];
+			import.function = i;
+		}
+	}
+
+	void writeWasm(OutputMemoryStream& blob) const {
+		blob.write(u32(0x6d736100));
+		blob.write(u32(1));
+
+		writeSection(blob, WasmSection::TYPE, [this](OutputMemoryStream& blob){
+			writeULEB128(blob, 3 + m_functions.size());
+			// setYaw
+			blob.write(u8(0x60));
+			blob.write(u8(2)); blob.write(WasmType::I32); blob.write(WasmType::F32);
+			blob.write(u8(0));
+			// setPropertyFloat
+			blob.write(u8(0x60));
+			blob.write(u8(3)); blob.write(WasmType::I32); blob.write(WasmType::I64); blob.write(WasmType::F32);
+			blob.write(u8(0));
+			// getPropertyFloat
+			blob.write(u8(0x60));
+			blob.write(u8(2)); blob.write(WasmType::I32); blob.write(WasmType::I64);
+			blob.write(u8(1)); blob.write(WasmType::F32);
+
+			for (const Function& fn : m_functions) {
+				blob.write(u8(0x60));
+				blob.write(u8(fn.num_args));
+				for (u32 i = 0; i < fn.num_args; ++i) blob.write(fn.args[i]);
+				blob.write(u8(0));
+			}
+		});
+
+		writeSection(blob, WasmSection::IMPORT, [](OutputMemoryStream& blob){
+			const char* names[] = { "setYaw", "setPropertyFloat", "getPropertyFloat" };
+			writeULEB128(blob, lengthOf(names));
+			for (u32 i = 0; i < lengthOf(names); ++i) {
+				writeString(blob, "LumixAPI");
+				writeString(blob, names[i]);
+				blob.write(WasmExternalType::FUNCTION);
+				writeULEB128(blob, i);
+			}
+		});
+
+		writeSection(blob, WasmSection::FUNCTION, [this](OutputMemoryStream& blob){
+			writeULEB128(blob, m_functions.size());
+			for (u32 i = 0; i < (u32)m_functions.size(); ++i) writeULEB128(blob, 3 + i);
+		});
+
+		writeSection(blob, WasmSection::GLOBAL, [this](OutputMemoryStream& blob){
+			writeULEB128(blob, 1 + m_globals.size());
+			blob.write(WasmType::I32);
+			blob.write(u8(1)); // mutable
+			blob.write(WasmOp::I32_CONST);
+			blob.write(u8(0));
+			blob.write(WasmOp::END);
+			for (float value : m_globals) {
+				blob.write(WasmType::F32);
+				blob.write(u8(1));
+				blob.write(WasmOp::F32_CONST);
+				blob.write(value);
+				blob.write(WasmOp::END);
+			}
+		});
+
+		writeSection(blob, WasmSection::EXPORT, [this](OutputMemoryStream& blob){
+			writeULEB128(blob, m_functions.size() + 1);
+			for (const Function& fn : m_functions) {
+				writeString(blob, fn.name);
+				blob.write(WasmExternalType::FUNCTION);
+				writeULEB128(blob, 3 + u32(&fn - m_functions.begin()));
+			}
+			writeString(blob, "self");
+			blob.write(WasmExternalType::GLOBAL);
+			writeULEB128(blob, 0);
+		});
+
+		writeSection(blob, WasmSection::CODE, [this](OutputMemoryStream& blob){
+			writeULEB128(blob, m_functions.size());
+			for (const Function& fn : m_functions) {
+				writeULEB128(blob, fn.code.blob.size() + 1);
+				blob.write(fn.code.blob.data(), fn.code.blob.size());
+				blob.write(WasmOp::END);
+			}
+		});
+	}
+
+	IAllocator& m_allocator;
+	Array<Function> m_functions;
+	Array<float> m_globals;
+	ScriptResource::AccessSet m_access_set;
+};
+
+// float property the property-heavy scenario reads and writes
+struct BenchmarkProperty {
+	ComponentType cmp_type = INVALID_COMPONENT_TYPE;
+	const char* cmp_name = nullptr;
+	const char* name = nullptr;
+	StableHash hash;
+};
+
+struct Scenario {
+	const char* name;
+	void (*build)(WasmModule& module, const BenchmarkProperty& property);
+	bool needs_property;
+	bool injects_events;
+};
+
+static const WasmType UPDATE_ARGS[] = { WasmType::F32 };
+
+// empty update, measures the cost of calling into wasm
+static void buildIdle(WasmModule& module, const BenchmarkProperty&) {
+	module.addFunction("update", Span(UPDATE_ARGS)).locals(0, 0);
+}
+
+// a loop of float math, result written once through setYaw
+static void buildArithmetic(WasmModule& module, const BenchmarkProperty&) {
+	static constexpr i32 ITERATIONS = 256;
+	// 0 - time_delta, 1 - i32 counter, 2 - f32 accumulator
+	module.addFunction("update", Span(UPDATE_ARGS))
+		.locals(1, 1)
+		.localGet(0).localSet(2)
+		.loop()
+			.localGet(2).f32Const(1.0001f).op(WasmOp::F32_MUL).localGet(0).op(WasmOp::F32_ADD).localSet(2)
+			.localGet(1).i32Const(1).op(WasmOp::I32_ADD).localTee(1).i32Const(ITERATIONS).op(WasmOp::I32_LT_S).brIf(0)
+		.op(WasmOp::END)
+		.self().localGet(2).call(LumixAPI::SET_YAW);
+	module.m_access_set.flags |= ScriptResource::AccessSet::WRITE_TRANSFORM;
+}
+
+// self.property += time_delta, several times per update
+static void buildProperty(WasmModule& module, const BenchmarkProperty& property) {
+	static constexpr u32 ACCESS_COUNT = 8;
+	WasmCode& code = module.addFunction("update", Span(UPDATE_ARGS)).locals(0, 0);
+	for (u32 i = 0; i < ACCESS_COUNT; ++i) {
+		code.self().i64Const(property.hash.getHashValue())
+			.self().i64Const(property.hash.getHashValue()).call(LumixAPI::GET_PROPERTY_FLOAT)
+			.localGet(0).op(WasmOp::F32_ADD)
+			.call(LumixAPI::SET_PROPERTY_FLOAT);
+	}
+	module.m_access_set.addRead(property.hash);
+	module.m_access_set.addWrite(property.hash);
+}
+
+// idle update, all the work is done in input handlers
+static void buildEvents(WasmModule& module, const BenchmarkProperty&) {
+	static const WasmType KEY_ARGS[] = { WasmType::I32 };
+	static const WasmType MOUSE_ARGS[] = { WasmType::F32, WasmType::F32 };
+	module.addFunction("update", Span(UPDATE_ARGS)).locals(0, 0);
+	module.addFunction("onKeyEvent", Span(KEY_ARGS))
+		.locals(0, 0)
+		.self().localGet(0).op(WasmOp::F32_CONVERT_I32_S).call(LumixAPI::SET_YAW);
+	module.addFunction("onMouseMove", Span(MOUSE_ARGS))
+		.locals(0, 0)
+		.self().localGet(0).localGet(1).op(WasmOp::F32_ADD).call(LumixAPI::SET_YAW);
+	module.m_access_set.flags |= ScriptResource::AccessSet::WRITE_TRANSFORM;
+}
+
+static const Scenario SCENARIOS[] = {
+	{ "idle", &buildIdle, false, false },
+	{ "arithmetic", &buildArithmetic, false, false },
+	{ "property", &buildProperty, true, false },
+	{ "events", &buildEvents, false, true },
+};
+
+static const u32 ENTITY_COUNTS[] = { 1000, 10000, 100000 };
+
+struct BenchmarkResult {
+	const char* scenario;
+	u32 entities;
+	u32 frames;
+	double instantiation_ms;
+	double update_ns_per_entity;
+	u64 memory_per_instance;
+	// heap allocations in the script phase after warm-up, must be 0
+	u32 allocations;
+};
+
+// the first float property of any registered component, so the benchmark does not depend on a specific plugin
+static bool findFloatProperty(BenchmarkProperty& property) {
+	for (const reflection::RegisteredComponent& cmp : reflection::getComponents()) {
+		if (!cmp.cmp) continue;
+
+		struct : reflection::IEmptyPropertyVisitor {
+			void visit(const reflection::Property<float>& prop) override {
+				if (!name) name = prop.name;
+			}
+			const char* name = nullptr;
+		} visitor;
+		cmp.cmp->visit(visitor);
+		if (!visitor.name) continue;
+
+		property.cmp_type = cmp.cmp->component_type;
+		property.cmp_name = cmp.cmp->name;
+		property.name = visitor.name;
+		property.hash = reflection::getPropertyHash(property.cmp_type, property.name);
+		return true;
+	}
+	return false;
+}
+
+static void injectEvents(InputSystem& input) {
+	os::Event key;
+	key.type = os::Event::Type::KEY;
+	key.key.down = true;
+	key.key.keycode = os::Keycode::A;
+	input.injectEvent(key, 0, 0);
+
+	os::Event mouse;
+	mouse.type = os::Event::Type::MOUSE_MOVE;
+	mouse.mouse_move.xrel = 1;
+	mouse.mouse_move.yrel = 1;
+	input.injectEvent(mouse, 0, 0);
+}
+
+// running world with `entity_count` entities with the same script
+struct BenchmarkWorld {
+	BenchmarkWorld(Engine& engine)
+		: engine(engine)
+		, entities(engine.getAllocator())
+	{}
+
+	~BenchmarkWorld() {
+		if (world) {
+			engine.stopGame(*world);
+			engine.destroyWorld(*world);
+		}
+		if (resource) {
+			manager->getResourceTable().erase(path.getHash());
+			resource->decRefCount();
+			LUMIX_DELETE(engine.getAllocator(), resource);
+		}
+	}
+
+	// `property` - component to create on each entity, can be null
+	bool create(const WasmModule& wasm, const char* name, u32 entity_count, const BenchmarkProperty* property) {
+		IAllocator& allocator = engine.getAllocator();
+		OutputMemoryStream compiled(allocator);
+		wasm.write(compiled);
+
+		manager = engine.getResourceManager().get(ScriptResource::TYPE);
+		ASSERT(manager);
+		path = Path("benchmark/", name, ".lvs");
+		resource = LUMIX_NEW(allocator, ScriptResource)(path, *manager, allocator);
+		resource->incRefCount();
+		if (!resource->create(static_cast<OutputMemoryStream&&>(compiled))) {
+			logError("Benchmark ", name, " failed to create script");
+			return false;
+		}
+		// so the resource can be loaded by path, e.g. when deserializing
+		manager->getResourceTable().insert(path.getHash(), resource);
+
+		world = &engine.createWorld();
+		module = (ScriptModule*)world->getModule(SCRIPT_TYPE);
+		entities.reserve(entity_count);
+		for (u32 i = 0; i < entity_count; ++i) {
+			const EntityRef e = world->createEntity({0, 0, 0}, Quat::IDENTITY);
+			entities.push(e);
+			world->createComponent(SCRIPT_TYPE, e);
+			module->assignScriptResource(e, *resource);
+			if (property) world->createComponent(property->cmp_type, e);
+		}
+		engine.startGame(*world);
+		return true;
+	}
+
+	Engine& engine;
+	ResourceManager* manager = nullptr;
+	Path path;
+	ScriptResource* resource = nullptr;
+	World* world = nullptr;
+	ScriptModule* module = nullptr;
+	Array<EntityRef> entities;
+};
+
+// loads the same script written at each ScriptResource::Version, so files compiled by older versions of the plugin
+// keep loading; returns false and logs the version which is not read back correctly
+static bool checkResourceVersions(Engine& engine) {
+	using Version = ScriptResource::Version;
+	IAllocator& allocator = engine.getAllocator();
+	ResourceManager* manager = engine.getResourceManager().get(ScriptResource::TYPE);
+	ASSERT(manager);
+	WasmModule wasm(allocator);
+	buildIdle(wasm, BenchmarkProperty());
+	OutputMemoryStream module_only(allocator);
+	wasm.writeWasm(module_only);
+
+	bool all_ok = true;
+	for (u32 v = 0; v <= (u32)Version::LAST; ++v) {
+		const Version version = (Version)v;
+		OutputMemoryStream compiled(allocator);
+		wasm.write(compiled, version);
+		ScriptResource resource(Path("benchmark/version.lvs"), *manager, allocator);
+		resource.incRefCount();
+		bool ok = resource.create(Span(compiled.data(), (u32)compiled.size()));
+		ok = ok && resource.m_bytecode.length() == module_only.size();
+		ok = ok && resource.m_metadata.valid == (version > Version::METADATA);
+		ok = ok && resource.m_validated == (version > Version::VALIDATION);
+		if (!ok) logError("Script compiled with version ", v, " is not loaded correctly");
+		all_ok = all_ok && ok;
+		resource.decRefCount();
+	}
+	return all_ok;
+}
+
+// `input_path` - if not null, scenarios with events replay this input recording instead of synthetic events,
+// and time of each frame is written to `frames`, so runs can be compared frame by frame
+static bool runScenario(Engine& engine
+	, const Scenario& scenario
+	, const BenchmarkProperty& property
+	, u32 entity_count
+	, const char* input_path
+	, OutputMemoryStream& frames
+	, BenchmarkResult& result)
+{
+	PROFILE_FUNCTION();
+	WasmModule wasm(engine.getAllocator());
+	scenario.build(wasm, property);
+
+	BenchmarkWorld bench(engine);
+	if (!bench.create(wasm, scenario.name, entity_count, scenario.needs_property ? &property : nullptr)) return false;
+
+	InputSystem& input = engine.getInputSystem();
+	const float time_delta = 1 / 60.f;
+
+	// the first update instantiates all scripts and calls their `start`
+	os::Timer timer;
+	bench.module->update(time_delta);
+	result.instantiation_ms = timer.tick() * 1000.0;
+
+	result.scenario = scenario.name;
+	result.entities = entity_count;
+	double update_time = 0;
+	const bool replay = scenario.injects_events && input_path && bench.module->replayInput(input_path, time_delta);
+	if (replay) {
+		frames << "{\"name\": \"frames/" << scenario.name << "\", \"entities\": " << entity_count << ", \"frame_us\": [";
+		result.frames = 0;
+		while (bench.module->isReplayingInput()) {
+			timer.tick();
+			bench.module->update(time_delta);
+			const double frame_time = timer.tick();
+			update_time += frame_time;
+			if (result.frames > 0) frames << ", ";
+			frames << frame_time * 1e6;
+			++result.frames;
+		}
+		frames << "]}\n";
+		if (result.frames == 0) {
+			logError("Input recording ", input_path, " is empty");
+			return false;
+		}
+	}
+	else {
+		result.frames = maximum(10u, 100'000 / entity_count);
+		for (u32 frame = 0; frame < result.frames; ++frame) {
+			if (scenario.injects_events) {
+				input.update(time_delta);
+				injectEvents(input);
+			}
+			timer.tick();
+			bench.module->update(time_delta);
+			update_time += timer.tick();
+		}
+	}
+	result.update_ns_per_entity = update_time * 1e9 / (double(result.frames) * entity_count);
+
+	// not timed, since tracking has overhead; frames before are not counted, tracking restarts the module's warm-up
+	static constexpr u32 ALLOCATION_WARMUP_FRAMES = 60;
+	static constexpr u32 ALLOCATION_CHECK_FRAMES = 60;
+	bench.module->setAllocationTracking(true);
+	result.allocations = 0;
+	for (u32 frame = 0; frame < ALLOCATION_WARMUP_FRAMES + ALLOCATION_CHECK_FRAMES; ++frame) {
+		if (scenario.injects_events) {
+			input.update(time_delta);
+			injectEvents(input);
+		}
+		bench.module->update(time_delta);
+		if (frame >= ALLOCATION_WARMUP_FRAMES) result.allocations += bench.module->getPhaseAllocations();
+	}
+	bench.module->setAllocationTracking(false);
+	if (result.allocations != 0) {
+		logError("Benchmark ", scenario.name, "/", entity_count, " made ", result.allocations, " allocation(s) in ", ALLOCATION_CHECK_FRAMES, " frames after warm-up");
+	}
+
+	const ScriptMemoryStats memory = bench.module->getResourceMemoryStats(bench.path);
+	result.memory_per_instance = memory.instances ? memory.total() / memory.instances : 0;
+	return true;
+}
+
+// host call overhead is measured by linking stripped down versions of LumixAPI functions, each stage does a bit more
+// than the previous one, so the difference between stages is the cost of the part the stage adds
+enum class HostCallStage : u32 {
+	LOOP,		// the same loop without the call
+	DISPATCH,	// host function returns immediately - interpreter dispatch, op_CallRawFunction
+	UNPACK,		// host function reads its arguments
+	LOOKUP,		// host function also looks up the property in reflection
+	FULL,		// the real LumixAPI function, run through ScriptModule, i.e. including the world setter/getter
+
+	COUNT
+};
+
+static const char* const HOST_CALL_STAGE_NAMES[] = { "loop", "dispatch", "unpack", "lookup", "full" };
+static_assert(lengthOf(HOST_CALL_STAGE_NAMES) == (u32)HostCallStage::COUNT);
+
+// keeps the unpacked arguments alive, so the compiler can not optimize the stages away
+static volatile u64 g_host_call_sink = 0;
+
+template <HostCallStage STAGE>
+static m3ApiRawFunction(benchSetYaw) {
+	if constexpr (STAGE == HostCallStage::DISPATCH) return m3Err_none;
+
+	m3ApiGetArg(EntityRef, entity);
+	m3ApiGetArg(float, yaw);
+	g_host_call_sink = entity.index + (u64)yaw;
+	if constexpr (STAGE == HostCallStage::LOOKUP) {
+		const Quat rot(Vec3(0, 1, 0), yaw);
+		g_host_call_sink = (u64)rot.w;
+	}
+	return m3Err_none;
+}
+
+template <HostCallStage STAGE>
+static m3ApiRawFunction(benchSetPropertyFloat) {
+	if constexpr (STAGE == HostCallStage::DISPATCH) return m3Err_none;
+
+	m3ApiGetArg(EntityRef, entity);
+	m3ApiGetArg(StableHash, property_hash);
+	m3ApiGetArg(float, value);
+	g_host_call_sink = entity.index + property_hash.getHashValue() + (u64)value;
+	if constexpr (STAGE == HostCallStage::LOOKUP) {
+		g_host_call_sink = (u64)(uintptr)reflection::getPropertyFromHash(property_hash);
+	}
+	return m3Err_none;
+}
+
+template <HostCallStage STAGE>
+static m3ApiRawFunction(benchGetPropertyFloat) {
+	m3ApiReturnType(float);
+	if constexpr (STAGE == HostCallStage::DISPATCH) m3ApiReturn(0);
+
+	m3ApiGetArg(EntityRef, entity);
+	m3ApiGetArg(StableHash, property_hash);
+	g_host_call_sink = entity.index + property_hash.getHashValue();
+	if constexpr (STAGE == HostCallStage::LOOKUP) {
+		g_host_call_sink = (u64)(uintptr)reflection::getPropertyFromHash(property_hash);
+	}
+	m3ApiReturn(0);
+}
+
+struct HostCall {
+	const char* name;
+	LumixAPI api;
+	bool needs_property;
+};
+
+static const HostCall HOST_CALLS[] = {
+	{ "setYaw", LumixAPI::SET_YAW, false },
+	{ "setPropertyFloat", LumixAPI::SET_PROPERTY_FLOAT, true },
+	{ "getPropertyFloat", LumixAPI::GET_PROPERTY_FLOAT, true },
+};
+
+struct HostCallResult {
+	const char* name;
+	u32 iterations;
+	// seconds, best of several runs
+	double stage_times[(u32)HostCallStage::COUNT];
+};
+
+// update(time_delta) calls `call` `iterations` times in a loop
+static void buildHostCallLoop(WasmModule& module, const HostCall& call, const BenchmarkProperty& property, u32 iterations, bool with_call) {
+	WasmCode& code = module.addFunction("update", Span(UPDATE_ARGS)).locals(1, 0);
+	code.loop();
+	if (with_call) {
+		switch (call.api) {
+			case LumixAPI::SET_YAW:
+				code.self().f32Const(0.5f).call(call.api);
+				break;
+			case LumixAPI::SET_PROPERTY_FLOAT:
+				code.self().i64Const(property.hash.getHashValue()).f32Const(0.5f).call(call.api);
+				break;
+			case LumixAPI::GET_PROPERTY_FLOAT:
+				code.self().i64Const(property.hash.getHashValue()).call(call.api).op(WasmOp::DROP);
+				break;
+		}
+	}
+	code.localGet(1).i32Const(1).op(WasmOp::I32_ADD).localTee(1).i32Const(iterations).op(WasmOp::I32_LT_S).brIf(0)
+		.op(WasmOp::END);
+}
+
+// runs `update` of `wasm` in a standalone runtime with LumixAPI replaced by the STAGE versions
+template <HostCallStage STAGE>
+static bool timeStandalone(const WasmModule& wasm, EntityRef self, u32 runs, IAllocator& allocator, double& best_time) {
+	OutputMemoryStream bytecode(allocator);
+	wasm.writeWasm(bytecode);
+
+	IM3Environment env = m3_NewEnvironment();
+	IM3Runtime runtime = m3_NewRuntime(env, ScriptResource::Metadata::DEFAULT_STACK_SIZE, nullptr);
+	IM3Module module;
+	bool success = false;
+	M3Result res = m3_ParseModule(env, &module, bytecode.data(), (u32)bytecode.size());
+	if (res == m3Err_none) {
+		res = m3_LoadModule(runtime, module);
+		if (res != m3Err_none) m3_FreeModule(module);
+	}
+	if (res == m3Err_none) {
+		m3_LinkRawFunction(module, "LumixAPI", "setYaw", nullptr, &benchSetYaw<STAGE>);
+		m3_LinkRawFunction(module, "LumixAPI", "setPropertyFloat", nullptr, &benchSetPropertyFloat<STAGE>);
+		m3_LinkRawFunction(module, "LumixAPI", "getPropertyFloat", nullptr, &benchGetPropertyFloat<STAGE>);
+
+		M3TaggedValue self_value;
+		self_value.type = c_m3Type_i32;
+		self_value.value.i32 = self.index;
+		m3_SetGlobal(m3_FindGlobal(module, "self"), &self_value);
+
+		IM3Function update_fn;
+		res = m3_FindFunction(&update_fn, runtime, "update");
+		if (res == m3Err_none) {
+			success = true;
+			os::Timer timer;
+			for (u32 i = 0; i < runs && success; ++i) {
+				timer.tick();
+				success = m3_CallV(update_fn, 0.f) == m3Err_none;
+				best_time = minimum(best_time, (double)timer.tick());
+			}
+		}
+	}
+	if (!success) logError("Host call benchmark failed: ", res ? res : "call failed");
+
+	m3_FreeRuntime(runtime);
+	m3_FreeEnvironment(env);
+	return success;
+}
+
+static bool runHostCall(Engine& engine, const HostCall& call, const BenchmarkProperty& property, HostCallResult& result) {
+	PROFILE_FUNCTION();
+	static constexpr u32 ITERATIONS = 100'000;
+	static constexpr u32 RUNS = 10;
+	IAllocator& allocator = engine.getAllocator();
+
+	WasmModule loop_wasm(allocator);
+	buildHostCallLoop(loop_wasm, call, property, ITERATIONS, false);
+	WasmModule call_wasm(allocator);
+	buildHostCallLoop(call_wasm, call, property, ITERATIONS, true);
+	if (call.api == LumixAPI::SET_YAW) call_wasm.m_access_set.flags |= ScriptResource::AccessSet::WRITE_TRANSFORM;
+	if (call.api == LumixAPI::SET_PROPERTY_FLOAT) call_wasm.m_access_set.addWrite(property.hash);
+	if (call.api == LumixAPI::GET_PROPERTY_FLOAT) call_wasm.m_access_set.addRead(property.hash);
+
+	// a single entity, with the real component, so the full stage calls the real setter
+	BenchmarkWorld bench(engine);
+	if (!bench.create(call_wasm, call.name, 1, call.needs_property ? &property : nullptr)) return false;
+	const EntityRef self = bench.entities[0];
+
+	result.name = call.name;
+	result.iterations = ITERATIONS;
+	for (double& t : result.stage_times) t = DBL_MAX;
+	if (!timeStandalone<HostCallStage::LOOP>(loop_wasm, self, RUNS, allocator, result.stage_times[(u32)HostCallStage::LOOP])) return false;
+	if (!timeStandalone<HostCallStage::DISPATCH>(call_wasm, self, RUNS, allocator, result.stage_times[(u32)HostCallStage::DISPATCH])) return false;
+	if (!timeStandalone<HostCallStage::UNPACK>(call_wasm, self, RUNS, allocator, result.stage_times[(u32)HostCallStage::UNPACK])) return false;
+	if (!timeStandalone<HostCallStage::LOOKUP>(call_wasm, self, RUNS, allocator, result.stage_times[(u32)HostCallStage::LOOKUP])) return false;
+
+	// the first update instantiates the script
+	const float time_delta = 1 / 60.f;
+	bench.module->update(time_delta);
+	os::Timer timer;
+	double& full_time = result.stage_times[(u32)HostCallStage::FULL];
+	for (u32 i = 0; i < RUNS; ++i) {
+		timer.tick();
+		bench.module->update(time_delta);
+		full_time = minimum(full_time, (double)timer.tick());
+	}
+	return true;
+}
+
+static void writeHostCallResult(OutputMemoryStream& blob, const HostCallResult& result) {
+	const double to_ns = 1e9 / result.iterations;
+	blob << "{\"name\": \"host_call/" << result.name << "\""
+		<< ", \"iterations\": " << result.iterations;
+	// cost of what the stage adds to the previous one
+	for (u32 i = 1; i < (u32)HostCallStage::COUNT; ++i) {
+		blob << ", \"" << HOST_CALL_STAGE_NAMES[i] << "_ns\": " << (result.stage_times[i] - result.stage_times[i - 1]) * to_ns;
+	}
+	const double total = result.stage_times[(u32)HostCallStage::FULL] - result.stage_times[(u32)HostCallStage::LOOP];
+	blob << ", \"total_ns\": " << total * to_ns << "}\n";
+}
+
+struct LoadResult {
+	const char* scenario;
+	u32 entities;
+	double deserialize_ms;
+	// scripts are parsed, compiled, linked and started in the first update
+	double first_update_ms;
+	double worst_frame_ms;
+};
+
+// serializes a world with scripted entities and times loading it back; the resource is served from memory,
+// so file IO is not included, only what the script module does
+static bool runLoad(Engine& engine, const Scenario& scenario, const BenchmarkProperty& property, u32 entity_count, LoadResult& result) {
+	PROFILE_FUNCTION();
+	static constexpr u32 FRAMES = 10;
+	IAllocator& allocator = engine.getAllocator();
+	WasmModule wasm(allocator);
+	scenario.build(wasm, property);
+
+	BenchmarkWorld source(engine);
+	if (!source.create(wasm, scenario.name, entity_count, scenario.needs_property ? &property : nullptr)) return false;
+	OutputMemoryStream serialized(allocator);
+	source.module->serialize(serialized);
+
+	World& world = engine.createWorld();
+	ScriptModule* module = (ScriptModule*)world.getModule(SCRIPT_TYPE);
+	EntityMap entity_map(allocator);
+	entity_map.reserve(entity_count);
+	for (EntityRef src : source.entities) {
+		const EntityRef e = world.createEntity({0, 0, 0}, Quat::IDENTITY);
+		entity_map.set(src, e);
+		if (scenario.needs_property) world.createComponent(property.cmp_type, e);
+	}
+	engine.startGame(world);
+
+	os::Timer timer;
+	InputMemoryStream blob(serialized);
+	module->deserialize(blob, entity_map, module->getVersion());
+	result.deserialize_ms = timer.tick() * 1000.0;
+
+	const float time_delta = 1 / 60.f;
+	result.scenario = scenario.name;
+	result.entities = entity_count;
+	result.worst_frame_ms = 0;
+	for (u32 frame = 0; frame < FRAMES; ++frame) {
+		timer.tick();
+		module->update(time_delta);
+		const double frame_ms = timer.tick() * 1000.0;
+		if (frame == 0) result.first_update_ms = frame_ms;
+		result.worst_frame_ms = maximum(result.worst_frame_ms, frame_ms);
+	}
+
+	engine.stopGame(world);
+	engine.destroyWorld(world);
+	return true;
+}
+
+static void writeLoadResult(OutputMemoryStream& blob, const LoadResult& result) {
+	const double total_ms = result.deserialize_ms + result.first_update_ms;
+	blob << "{\"name\": \"load/" << result.scenario << "\""
+		<< ", \"entities\": " << result.entities
+		<< ", \"deserialize_ms\": " << result.deserialize_ms
+		<< ", \"first_update_ms\": " << result.first_update_ms
+		<< ", \"total_ms\": " << total_ms
+		<< ", \"per_entity_us\": " << total_ms * 1000 / result.entities
+		<< ", \"worst_frame_ms\": " << result.worst_frame_ms
+		<< "}\n";
+}
+
+static void writeResult(OutputMemoryStream& blob, const BenchmarkResult& result) {
+	blob << "{\"name\": \"" << result.scenario << "\""
+		<< ", \"entities\": " << result.entities
+		<< ", \"frames\": " << result.frames
+		<< ", \"instantiation_ms\": " << result.instantiation_ms
+		<< ", \"update_ns_per_entity\": " << result.update_ns_per_entity
+		<< ", \"memory_per_instance\": " << result.memory_per_instance
+		<< ", \"allocations\": " << result.allocations
+		<< "}\n";
+}
+
+// gameplay behaviours implemented both as compiled visual scripts and as Lua scripts, to compare the two runtimes
+struct Behaviour {
+	const char* name;
+	void (*build)(WasmModule& module, const BenchmarkProperty& property);
+	void (*writeLua)(OutputMemoryStream& source, const BenchmarkProperty& property);
+	bool needs_property;
+};
+
+static constexpr float MOUSE_SENSITIVITY = 0.01f;
+static constexpr float LERP_TARGET = 1.f;
+static constexpr float LERP_RATE = 4.f;
+static constexpr float TOGGLE_YAW = 1.57f;
+
+// yaw follows horizontal mouse movement
+static void buildRotateToMouse(WasmModule& module, const BenchmarkProperty&) {
+	static const WasmType MOUSE_ARGS[] = { WasmType::F32, WasmType::F32 };
+	const u32 yaw = module.addGlobal(0);
+	module.addFunction("onMouseMove", Span(MOUSE_ARGS))
+		.locals(0, 0)
+		.globalGet(yaw).localGet(0).f32Const(MOUSE_SENSITIVITY).op(WasmOp::F32_MUL).op(WasmOp::F32_ADD).globalSet(yaw);
+	module.addFunction("update", Span(UPDATE_ARGS))
+		.locals(0, 0)
+		.self().globalGet(yaw).call(LumixAPI::SET_YAW);
+	module.m_access_set.flags |= ScriptResource::AccessSet::WRITE_TRANSFORM;
+}
+
+static void writeRotateToMouseLua(OutputMemoryStream& source, const BenchmarkProperty&) {
+	source << "local yaw = 0\n"
+		<< "function onInputEvent(event)\n"
+		<< "	if event.type == \"axis\" and event.device.type == \"mouse\" then\n"
+		<< "		yaw = yaw + event.x * " << MOUSE_SENSITIVITY << "\n"
+		<< "	end\n"
+		<< "end\n"
+		<< "function update(time_delta)\n"
+		<< "	this.rotation = { 0, math.sin(yaw * 0.5), 0, math.cos(yaw * 0.5) }\n"
+		<< "end\n";
+}
+
+// property moves toward a constant
+static void buildPropertyLerp(WasmModule& module, const BenchmarkProperty& property) {
+	// 0 - time_delta, 1 - current value
+	module.addFunction("update", Span(UPDATE_ARGS))
+		.locals(0, 1)
+		.self().i64Const(property.hash.getHashValue()).call(LumixAPI::GET_PROPERTY_FLOAT).localSet(1)
+		.self().i64Const(property.hash.getHashValue())
+		.localGet(1)
+		.f32Const(LERP_TARGET).localGet(1).op(WasmOp::F32_SUB)
+		.localGet(0).op(WasmOp::F32_MUL).f32Const(LERP_RATE).op(WasmOp::F32_MUL)
+		.op(WasmOp::F32_ADD)
+		.call(LumixAPI::SET_PROPERTY_FLOAT);
+	module.m_access_set.addRead(property.hash);
+	module.m_access_set.addWrite(property.hash);
+}
+
+// the Lua plugin exposes components and properties by lowercase names, with spaces replaced by underscores
+static void writeLuaName(OutputMemoryStream& source, const char* name) {
+	for (const char* c = name; *c; ++c) {
+		const char lua_char = *c == ' ' ? '_' : (*c >= 'A' && *c <= 'Z' ? *c - 'A' + 'a' : *c);
+		source.write(lua_char);
+	}
+}
+
+static void writePropertyLerpLua(OutputMemoryStream& source, const BenchmarkProperty& property) {
+	source << "function update(time_delta)\n"
+		<< "	local cmp = this.";
+	writeLuaName(source, property.cmp_name);
+	source << "\n	local value = cmp.";
+	writeLuaName(source, property.name);
+	source << "\n	cmp.";
+	writeLuaName(source, property.name);
+	source << " = value + (" << LERP_TARGET << " - value) * time_delta * " << LERP_RATE << "\n"
+		<< "end\n";
+}
+
+// every key event flips the entity between two orientations
+static void buildKeyToggle(WasmModule& module, const BenchmarkProperty&) {
+	static const WasmType KEY_ARGS[] = { WasmType::I32 };
+	const u32 toggled = module.addGlobal(0);
+	module.addFunction("onKeyEvent", Span(KEY_ARGS))
+		.locals(0, 0)
+		.f32Const(1).globalGet(toggled).op(WasmOp::F32_SUB).globalSet(toggled);
+	module.addFunction("update", Span(UPDATE_ARGS))
+		.locals(0, 0)
+		.self().globalGet(toggled).f32Const(TOGGLE_YAW).op(WasmOp::F32_MUL).call(LumixAPI::SET_YAW);
+	module.m_access_set.flags |= ScriptResource::AccessSet::WRITE_TRANSFORM;
+}
+
+static void writeKeyToggleLua(OutputMemoryStream& source, const BenchmarkProperty&) {
+	source << "local toggled = 0\n"
+		<< "function onInputEvent(event)\n"
+		<< "	if event.type == \"button\" and event.device.type == \"keyboard\" then\n"
+		<< "		toggled = 1 - toggled\n"
+		<< "	end\n"
+		<< "end\n"
+		<< "function update(time_delta)\n"
+		<< "	local yaw = toggled * " << TOGGLE_YAW << "\n"
+		<< "	this.rotation = { 0, math.sin(yaw * 0.5), 0, math.cos(yaw * 0.5) }\n"
+		<< "end\n";
+}
+
+static const Behaviour BEHAVIOURS[] = {
+	{ "rotate_to_mouse", &buildRotateToMouse, &writeRotateToMouseLua, false },
+	{ "property_lerp", &buildPropertyLerp, &writePropertyLerpLua, true },
+	{ "key_toggle", &buildKeyToggle, &writeKeyToggleLua, false },
+};
+
+struct ComparisonResult {
+	const char* behaviour;
+	const char* runtime;
+	u32 entities;
+	double instantiation_ms;
+	double update_ns_per_entity;
+	u64 memory_per_instance;
+};
+
+// reflection of the Lua plugin's component, so the benchmark does not have to link the plugin
+struct LuaScriptComponent {
+	ComponentType type = INVALID_COMPONENT_TYPE;
+	const reflection::ArrayProperty* scripts = nullptr;
+	const reflection::Property<Path>* path = nullptr;
+};
+
+static bool findLuaScriptComponent(LuaScriptComponent& lua) {
+	for (const reflection::RegisteredComponent& cmp : reflection::getComponents()) {
+		if (!cmp.cmp || !equalStrings(cmp.cmp->name, "lua_script")) continue;
+
+		struct : reflection::IEmptyPropertyVisitor {
+			void visit(const reflection::ArrayProperty& prop) override {
+				if (!array) array = &prop;
+			}
+			const reflection::ArrayProperty* array = nullptr;
+		} array_visitor;
+		cmp.cmp->visit(array_visitor);
+		if (!array_visitor.array) return false;
+
+		struct : reflection::IEmptyPropertyVisitor {
+			void visit(const reflection::Property<Path>& prop) override {
+				if (!path) path = &prop;
+			}
+			const reflection::Property<Path>* path = nullptr;
+		} path_visitor;
+		array_visitor.array->visitChildren(path_visitor);
+		if (!path_visitor.path) return false;
+
+		lua.type = cmp.cmp->component_type;
+		lua.scripts = array_visitor.array;
+		lua.path = path_visitor.path;
+		return true;
+	}
+	return false;
+}
+
+static constexpr u32 COMPARISON_FRAMES = 100;
+
+static void runComparisonFrames(Engine& engine, IModule& module, u32 entity_count, ComparisonResult& result) {
+	InputSystem& input = engine.getInputSystem();
+	const float time_delta = 1 / 60.f;
+	os::Timer timer;
+	double update_time = 0;
+	for (u32 frame = 0; frame < COMPARISON_FRAMES; ++frame) {
+		input.update(time_delta);
+		injectEvents(input);
+		timer.tick();
+		module.update(time_delta);
+		update_time += timer.tick();
+	}
+	result.entities = entity_count;
+	result.update_ns_per_entity = update_time * 1e9 / (double(COMPARISON_FRAMES) * entity_count);
+}
+
+static bool runWasmComparison(Engine& engine, const Behaviour& behaviour, const BenchmarkProperty& property, u32 entity_count, ComparisonResult& result) {
+	PROFILE_FUNCTION();
+	WasmModule wasm(engine.getAllocator());
+	behaviour.build(wasm, property);
+
+	BenchmarkWorld bench(engine);
+	if (!bench.create(wasm, behaviour.name, entity_count, behaviour.needs_property ? &property : nullptr)) return false;
+
+	os::Timer timer;
+	bench.module->update(1 / 60.f);
+	result.instantiation_ms = timer.tick() * 1000.0;
+	result.behaviour = behaviour.name;
+	result.runtime = "wasm";
+	runComparisonFrames(engine, *bench.module, entity_count, result);
+
+	const ScriptMemoryStats memory = bench.module->getResourceMemoryStats(bench.path);
+	result.memory_per_instance = memory.instances ? memory.total() / memory.instances : 0;
+	return true;
+}
+
+// the Lua script is written to the project's filesystem, since the Lua plugin can load it only from there
+static bool runLuaComparison(Engine& engine
+	, const Behaviour& behaviour
+	, const BenchmarkProperty& property
+	, const LuaScriptComponent& lua
+	, u32 entity_count
+	, ComparisonResult& result)
+{
+	PROFILE_FUNCTION();
+	IAllocator& allocator = engine.getAllocator();
+	FileSystem& fs = engine.getFileSystem();
+	const Path path("benchmark/", behaviour.name, ".lua");
+	OutputMemoryStream source(allocator);
+	behaviour.writeLua(source, property);
+	if (!fs.saveContentSync(path, source)) {
+		logError("Failed to write ", path);
+		return false;
+	}
+
+	World& world = engine.createWorld();
+	IModule* module = world.getModule(lua.type);
+	ASSERT(module);
+	Array<EntityRef> entities(allocator);
+	entities.reserve(entity_count);
+	for (u32 i = 0; i < entity_count; ++i) {
+		const EntityRef e = world.createEntity({0, 0, 0}, Quat::IDENTITY);
+		entities.push(e);
+		world.createComponent(lua.type, e);
+		if (behaviour.needs_property) world.createComponent(property.cmp_type, e);
+	}
+	engine.startGame(world);
+
+	lua_State* L = engine.getState();
+	lua_gc(L, LUA_GCCOLLECT, 0);
+	const u64 memory_before = u64(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0);
+
+	// like the wasm runtime, includes loading the script and running its top level code for each entity
+	os::Timer timer;
+	for (EntityRef e : entities) {
+		ComponentUID cmp;
+		cmp.entity = e;
+		cmp.type = lua.type;
+		cmp.module = module;
+		lua.scripts->addItem(cmp, -1);
+		lua.path->set(cmp, 0, path);
+	}
+	while (fs.hasWork()) fs.processCallbacks();
+	module->update(1 / 60.f);
+	result.instantiation_ms = timer.tick() * 1000.0;
+
+	lua_gc(L, LUA_GCCOLLECT, 0);
+	const u64 memory_after = u64(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0);
+	result.memory_per_instance = memory_after > memory_before ? (memory_after - memory_before) / entity_count : 0;
+	result.behaviour = behaviour.name;
+	result.runtime = "lua";
+	runComparisonFrames(engine, *module, entity_count, result);
+
+	engine.stopGame(world);
+	engine.destroyWorld(world);
+	return true;
+}
+
+static void writeComparisonResult(OutputMemoryStream& blob, const ComparisonResult& result) {
+	blob << "{\"name\": \"compare/" << result.behaviour << "\""
+		<< ", \"runtime\": \"" << result.runtime << "\""
+		<< ", \"entities\": " << result.entities
+		<< ", \"instantiation_ms\": " << result.instantiation_ms
+		<< ", \"update_ns_per_entity\": " << result.update_ns_per_entity
+		<< ", \"memory_per_instance\": " << result.memory_per_instance
+		<< "}\n";
+}
+
+// value of `key` in a single line of the output, the output is written by writeResult, so it's not a general JSON parser
+static bool getValue(StringView line, const char* key, StringView& value) {
+	const char* found = findSubstring(line, key);
+	if (!found) return false;
+
+	value.begin = found + stringLength(key);
+	if (*value.begin == '"') ++value.begin;
+	value.end = value.begin;
+	while (value.end != line.end && *value.end != '"' && *value.end != ',' && *value.end != '}') ++value.end;
+	return true;
+}
+
+// logs results which are more than `TOLERANCE` slower than in the baseline
+static void compareWithBaseline(Span<const BenchmarkResult> results, const char* baseline_path, IAllocator& allocator) {
+	static constexpr double TOLERANCE = 0.1;
+
+	os::InputFile file;
+	if (!file.open(baseline_path)) {
+		logError("Failed to open benchmark baseline ", baseline_path);
+		return;
+	}
+	OutputMemoryStream content(allocator);
+	content.resize(file.size());
+	const bool read = file.read(content.getMutableData(), content.size());
+	file.close();
+	if (!read) {
+		logError("Failed to read benchmark baseline ", baseline_path);
+		return;
+	}
+
+	const char* iter = (const char*)content.data();
+	const char* end = iter + content.size();
+	while (iter != end) {
+		StringView line(iter, iter);
+		while (line.end != end && *line.end != '\n') ++line.end;
+		iter = line.end == end ? end : line.end + 1;
+
+		StringView name, entities, update_ns;
+		if (!getValue(line, "\"name\": ", name)) continue;
+		if (!getValue(line, "\"entities\": ", entities)) continue;
+		if (!getValue(line, "\"update_ns_per_entity\": ", update_ns)) continue;
+
+		const u32 entity_count = (u32)atoi(entities.begin);
+		const double baseline = atof(update_ns.begin);
+		for (const BenchmarkResult& result : results) {
+			if (result.entities != entity_count || !equalStrings(name, result.scenario)) continue;
+
+			if (result.update_ns_per_entity > baseline * (1 + TOLERANCE)) {
+				logError("Benchmark ", result.scenario, "/", result.entities, " regressed: ", result.update_ns_per_entity, " ns per entity, baseline ", baseline);
+			}
+		}
+	}
+}
+
+} // anonymous namespace
+
+void runScriptBenchmarks(Engine& engine, const char* output_path, const char* baseline_path, const char* input_path) {
+	PROFILE_FUNCTION();
+	IAllocator& allocator = engine.getAllocator();
+
+	checkResourceVersions(engine);
+
+	BenchmarkProperty property;
+	const bool has_property = findFloatProperty(property);
+	if (has_property) logInfo("Script benchmark uses ", property.cmp_name, ".", property.name, " as the float property");
+
+	Array<BenchmarkResult> results(allocator);
+	OutputMemoryStream frames(allocator);
+	for (const Scenario& scenario : SCENARIOS) {
+		if (scenario.needs_property && !has_property) {
+			logInfo("Script benchmark ", scenario.name, " skipped, there is no float property");
+			continue;
+		}
+		for (u32 entity_count : ENTITY_COUNTS) {
+			BenchmarkResult result;
+			if (runScenario(engine, scenario, property, entity_count, input_path, frames, result)) results.push(result);
+		}
+	}
+
+	OutputMemoryStream blob(allocator);
+	for (const BenchmarkResult& result : results) writeResult(blob, result);
+	blob.write(frames.data(), frames.size());
+
+	for (const HostCall& call : HOST_CALLS) {
+		if (call.needs_property && !has_property) continue;
+		HostCallResult result;
+		if (runHostCall(engine, call, property, result)) writeHostCallResult(blob, result);
+	}
+
+	for (const Scenario& scenario : SCENARIOS) {
+		if (scenario.needs_property && !has_property) continue;
+		for (u32 entity_count : ENTITY_COUNTS) {
+			LoadResult result;
+			if (runLoad(engine, scenario, property, entity_count, result)) writeLoadResult(blob, result);
+		}
+	}
+
+	LuaScriptComponent lua;
+	const bool has_lua = findLuaScriptComponent(lua);
+	if (!has_lua) logInfo("Script benchmark comparison with Lua skipped, lua_script component is not registered");
+	for (const Behaviour& behaviour : BEHAVIOURS) {
+		if (behaviour.needs_property && !has_property) continue;
+		for (u32 entity_count : ENTITY_COUNTS) {
+			ComparisonResult result;
+			if (runWasmComparison(engine, behaviour, property, entity_count, result)) writeComparisonResult(blob, result);
+			if (has_lua && runLuaComparison(engine, behaviour, property, lua, entity_count, result)) writeComparisonResult(blob, result);
+		}
+	}
+
+	os::OutputFile file;
+	if (!file.open(output_path)) {
+		logError("Failed to create ", output_path);
+	}
+	else {
+		if (!file.write(blob.data(), blob.size())) logError("Failed to write ", output_path);
+		file.close();
+		logInfo("Script benchmark results written to ", output_path);
+	}
+
+	if (baseline_path) compareWithBaseline(results, baseline_path, allocator);
+	else logWarning("No script benchmark baseline, results were not checked for regressions");
+}
+
+} // namespace Lumix
@@ -0,0 +1,16 @@
+#pragma once
+
+namespace Lumix {
+
+struct Engine;
+
+// headless benchmarks of the script runtime - throughput of whole scripts, cost of single LumixAPI calls, load times
+// and comparison with equivalent Lua scripts,
+// run with `-visualscript_benchmark <output>`
+// results are written as JSON lines to `output_path`, one object per benchmark;
+// if `baseline_path` is not null, results are compared with it and regressions are logged; baselines are output of
+// an earlier run on the same machine and configuration, none is committed, see README.md;
+// if `input_path` is not null, scenarios with events replay this input recording (see ScriptModule::recordInput)
+void runScriptBenchmarks(Engine& engine, const char* output_path, const char* baseline_path, const char* input_path);
+
+} // namespace Lumix